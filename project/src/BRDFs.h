@@ -5,6 +5,51 @@ namespace dae
 {
 	namespace BRDF
 	{
+		//Scalar terms on precomputed cosines, the functions on vectors below and the batch loops in MaterialBatch.cpp are built from these
+		//They are free of branches, so a loop over plain floats calling them stays vectorizable
+
+		/**
+		 * \param ks Specular Reflection Coefficient
+		 * \param exp Phong Exponent
+		 * \param cosAlpha Cosine between the reflected light direction and the view direction
+		 * \return Phong Specular Term
+		 */
+		static float PhongSpecular(float ks, float exp, float cosAlpha)
+		{
+			//A select, powf never sees a negative cosine
+			return cosAlpha > 0 ? ks * powf(std::max(cosAlpha, 0.f), exp) : 0.f;
+		}
+
+		/**
+		 * \param cosHalfView Cosine between the half vector and the view direction
+		 * \return Weight of (1 - f0) in the Schlick Fresnel Term
+		 */
+		static float FresnelWeight_Schlick(float cosHalfView)
+		{
+			return powf(1 - cosHalfView, 5);
+		}
+
+		/**
+		 * \param cosNormalHalf Cosine between the normal and the half vector
+		 * \param alphaSquared Squared(Squared(roughness))
+		 * \return Trowbridge-Reitz GGX Normal Distribution Term
+		 */
+		static float NormalDistribution_GGX(float cosNormalHalf, float alphaSquared)
+		{
+			return alphaSquared / (PI * Square(Square(cosNormalHalf) * (alphaSquared - 1) + 1));
+		}
+
+		/**
+		 * \param cosTheta Cosine between the normal and the view or light direction
+		 * \param k Squared(Squared(roughness) + 1) / 8
+		 * \return Schlick GGX Geometry Term
+		 */
+		static float GeometryFunction_SchlickGGX(float cosTheta, float k)
+		{
+			const float dot{ std::max(cosTheta, 0.f) };
+			return dot / (dot * (1 - k) + k);
+		}
+
 		/**
 		 * \param kd Diffuse Reflection Coefficient
 		 * \param cd Diffuse Color
@@ -32,10 +77,7 @@ namespace dae
 		static ColorRGB Phong(float ks, float exp, const Vector3& l, const Vector3& v, const Vector3& n)
 		{
 			Vector3 reflect = Vector3::Reflect(l, n);//{ l-2*(Vector3::Dot(n,l)*n)};
-			float cosAlpha{ Vector3::Dot(reflect,v) };
-			float p = 0.f;
-			if (cosAlpha > 0)
-				p = ks * powf(cosAlpha, exp);
+			const float p{ PhongSpecular(ks, exp, Vector3::Dot(reflect,v)) };
 			return {p, p, p};
 		}
 
@@ -48,7 +90,7 @@ namespace dae
 		 */
 		static ColorRGB FresnelFunction_Schlick(const Vector3& h, const Vector3& v, const ColorRGB& f0)
 		{
-			return { f0 + (ColorRGB{1,1,1}-f0) * powf(1 - Vector3::Dot(h,v),5) };
+			return { f0 + (ColorRGB{1,1,1}-f0) * FresnelWeight_Schlick(Vector3::Dot(h,v)) };
 		}
 
 		/**
@@ -61,7 +103,7 @@ namespace dae
 		static float NormalDistribution_GGX(const Vector3& n, const Vector3& h, float roughness)
 		{
 			const float alpha{ Square(roughness) };
-			return {Square(alpha) / (PI * Square(Square(Vector3::Dot(n,h)) * (Square(alpha) - 1) + 1))};
+			return NormalDistribution_GGX(Vector3::Dot(n,h), Square(alpha));
 		}
 
 
@@ -75,9 +117,8 @@ namespace dae
 		static float GeometryFunction_SchlickGGX(const Vector3& n, const Vector3& v, float roughness)
 		{
 			const float alpha{ Square(roughness) };
-			float k{ Square(alpha + 1) / 8 };
-			const float dot{ std::max(Vector3::Dot(n, v),0.f) };
-			return { dot / (dot * (1 - k) + k) };
+			const float k{ Square(alpha + 1) / 8 };
+			return GeometryFunction_SchlickGGX(Vector3::Dot(n, v), k);
 		}
 
 		/**
@@ -93,5 +134,31 @@ namespace dae
 			return { GeometryFunction_SchlickGGX(n,v,roughness) * GeometryFunction_SchlickGGX(n,l,roughness) };
 		}
 
+		/**
+		 * \brief BRDF Cook-Torrance specular, plus a Lambert diffuse lobe for pure dielectrics
+		 * \param albedo Albedo of the surface, the base reflectivity of metals
+		 * \param metalness 0 for dielectrics, 1 for conductors
+		 * \param roughness Roughness of the material
+		 * \param n Normal of the surface
+		 * \param l Normalized light direction
+		 * \param v Normalized view direction
+		 * \return Cook-Torrance Color
+		 */
+		static ColorRGB CookTorrence(const ColorRGB& albedo, float metalness, float roughness, const Vector3& n, const Vector3& l, const Vector3& v)
+		{
+			//Dielectrics reflect 4% head on, metals their albedo
+			const ColorRGB f0{ metalness < 1 ? ColorRGB{ 0.04f,0.04f,0.04f } : albedo };
+			const Vector3 h{ ((l + v) / (v + l).Magnitude()).Normalized() };
+
+			const ColorRGB F{ FresnelFunction_Schlick(h,v,f0) };
+			const ColorRGB D{ ColorRGB{1,1,1} * NormalDistribution_GGX(n,h,roughness) };
+			const ColorRGB G{ ColorRGB{1,1,1} * GeometryFunction_Smith(n,v,l,roughness) };
+			const ColorRGB specular{ (D * F * G) / (4 * (Vector3::Dot(v,n) * Vector3::Dot(l,n))) };
+
+			if (metalness == 0)
+				return specular + Lambert(ColorRGB{1,1,1} - F, albedo);
+			return specular;
+		}
+
 	}
 }
\ No newline at end of file
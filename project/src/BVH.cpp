@@ -0,0 +1,507 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <utility>
+
+#include "ParallelFor.h"
+
+namespace dae
+{
+	//Shared by every tree, so a wide BVH can never mistake another tree for the one it was collapsed from
+	static std::atomic<uint64_t> s_NextTopologyVersion{ 1 };
+
+	//Spreads the lowest 21 bits of value so two zero bits sit between every bit
+	static uint64_t ExpandMortonBits(uint64_t value)
+	{
+		value &= 0x1fffff;
+		value = (value | value << 32) & 0x1f00000000ffff;
+		value = (value | value << 16) & 0x1f0000ff0000ff;
+		value = (value | value << 8) & 0x100f00f00f00f00f;
+		value = (value | value << 4) & 0x10c30c30c30c30c3;
+		value = (value | value << 2) & 0x1249249249249249;
+		return value;
+	}
+
+	//Stable LSD radix sort on 8 bit digits, every range counts and scatters its own part of the keys in parallel
+	static void RadixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& values, int nrKeyBits)
+	{
+		constexpr int digitBits{ 8 };
+		constexpr uint32_t nrDigits{ 1 << digitBits };
+		constexpr uint32_t minRangeSize{ 4096 };
+		const uint32_t count{ static_cast<uint32_t>(keys.size()) };
+
+		std::vector<uint64_t> sortedKeys(count);
+		std::vector<uint32_t> sortedValues(count);
+
+		std::vector<std::array<uint32_t, nrDigits>> histograms(GetNrParallelRanges(count, minRangeSize));
+
+		for (int shift{}; shift < nrKeyBits; shift += digitBits)
+		{
+			ParallelForRanges(count, minRangeSize, [&](uint32_t rangeIndex, uint32_t begin, uint32_t end)
+				{
+					std::array<uint32_t, nrDigits>& histogram{ histograms[rangeIndex] };
+					histogram.fill(0);
+					for (uint32_t i{ begin }; i < end; ++i)
+					{
+						++histogram[(keys[i] >> shift) & (nrDigits - 1)];
+					}
+				});
+
+			//Digit-major prefix sum, so within a digit the ranges keep their original order
+			uint32_t offset{};
+			for (uint32_t digit{}; digit < nrDigits; ++digit)
+			{
+				for (std::array<uint32_t, nrDigits>& histogram : histograms)
+				{
+					const uint32_t digitCount{ histogram[digit] };
+					histogram[digit] = offset;
+					offset += digitCount;
+				}
+			}
+
+			ParallelForRanges(count, minRangeSize, [&](uint32_t rangeIndex, uint32_t begin, uint32_t end)
+				{
+					std::array<uint32_t, nrDigits>& histogram{ histograms[rangeIndex] };
+					for (uint32_t i{ begin }; i < end; ++i)
+					{
+						const uint32_t destination{ histogram[(keys[i] >> shift) & (nrDigits - 1)]++ };
+						sortedKeys[destination] = keys[i];
+						sortedValues[destination] = values[i];
+					}
+				});
+
+			keys.swap(sortedKeys);
+			values.swap(sortedValues);
+		}
+	}
+
+	void BVH::Build(const std::vector<AABB>& primitiveBounds)
+	{
+		if (m_BuildMode == BVHBuildMode::Linear)
+			BuildLinear(primitiveBounds);
+		else
+			BuildSAH(primitiveBounds);
+	}
+
+	void BVH::BuildSAH(const std::vector<AABB>& primitiveBounds)
+	{
+		Clear();
+
+		const uint32_t nrPrimitives{ static_cast<uint32_t>(primitiveBounds.size()) };
+		if (nrPrimitives == 0)
+			return;
+
+		m_PrimitiveIndices.resize(nrPrimitives);
+		m_Centroids.resize(nrPrimitives);
+		for (uint32_t i{}; i < nrPrimitives; ++i)
+		{
+			m_PrimitiveIndices[i] = i;
+			m_Centroids[i] = primitiveBounds[i].Center();
+		}
+
+		//A binary tree with N leaves never has more than 2N - 1 nodes, so node references stay valid while building
+		m_Nodes.reserve(2 * size_t(nrPrimitives) - 1);
+
+		BVHNode root{};
+		root.leftFirst = 0;
+		root.primitiveCount = nrPrimitives;
+		UpdateNodeBounds(root, primitiveBounds);
+		m_Nodes.push_back(root);
+
+		struct BuildTask
+		{
+			uint32_t nodeIndex;
+			int depth;
+		};
+		std::vector<BuildTask> tasks{ { 0, 1 } };
+
+		while (!tasks.empty())
+		{
+			const BuildTask task{ tasks.back() };
+			tasks.pop_back();
+
+			BVHNode& node{ m_Nodes[task.nodeIndex] };
+			if (node.primitiveCount <= 1 || task.depth >= MaxDepth)
+				continue;
+
+			int axis{};
+			float splitPosition{};
+			const float splitCost{ FindBestSplit(node, primitiveBounds, axis, splitPosition) };
+
+			AABB nodeBounds{ node.minAABB, node.maxAABB };
+			const float leafCost{ node.primitiveCount * nodeBounds.Area() };
+			if (splitCost >= leafCost)
+				continue;
+
+			//Partition the primitive indices in place around the split plane
+			int i{ static_cast<int>(node.leftFirst) };
+			int j{ i + static_cast<int>(node.primitiveCount) - 1 };
+			while (i <= j)
+			{
+				if (m_Centroids[m_PrimitiveIndices[i]][axis] < splitPosition)
+					++i;
+				else
+					std::swap(m_PrimitiveIndices[i], m_PrimitiveIndices[j--]);
+			}
+
+			const uint32_t leftCount{ static_cast<uint32_t>(i) - node.leftFirst };
+			if (leftCount == 0 || leftCount == node.primitiveCount)
+				continue;
+
+			BVHNode leftChild{};
+			leftChild.leftFirst = node.leftFirst;
+			leftChild.primitiveCount = leftCount;
+			UpdateNodeBounds(leftChild, primitiveBounds);
+
+			BVHNode rightChild{};
+			rightChild.leftFirst = static_cast<uint32_t>(i);
+			rightChild.primitiveCount = node.primitiveCount - leftCount;
+			UpdateNodeBounds(rightChild, primitiveBounds);
+
+			const uint32_t leftChildIndex{ static_cast<uint32_t>(m_Nodes.size()) };
+			node.leftFirst = leftChildIndex;
+			node.primitiveCount = 0;
+
+			m_Nodes.push_back(leftChild);
+			m_Nodes.push_back(rightChild);
+
+			tasks.push_back({ leftChildIndex, task.depth + 1 });
+			tasks.push_back({ leftChildIndex + 1, task.depth + 1 });
+		}
+
+		m_BuildCost = CalculateCost();
+		m_Cost = m_BuildCost;
+	}
+
+	void BVH::BuildLinear(const std::vector<AABB>& primitiveBounds)
+	{
+		Clear();
+
+		const uint32_t nrPrimitives{ static_cast<uint32_t>(primitiveBounds.size()) };
+		if (nrPrimitives == 0)
+			return;
+
+		//Quantize the centroids inside their bounds and interleave the bits into a Morton code
+		AABB centroidBounds{};
+		m_Centroids.resize(nrPrimitives);
+		for (uint32_t i{}; i < nrPrimitives; ++i)
+		{
+			m_Centroids[i] = primitiveBounds[i].Center();
+			centroidBounds.Grow(m_Centroids[i]);
+		}
+
+		//30 bit codes sort in half the passes, 63 bit codes keep big meshes from piling many primitives into one cell
+		const int nrMortonBits{ nrPrimitives < (1u << 16) ? 30 : 63 };
+		const float cellCount{ static_cast<float>((1 << (nrMortonBits / 3)) - 1) };
+		const Vector3 extent{ centroidBounds.max - centroidBounds.min };
+		const Vector3 scale{
+			extent.x > 0.f ? cellCount / extent.x : 0.f,
+			extent.y > 0.f ? cellCount / extent.y : 0.f,
+			extent.z > 0.f ? cellCount / extent.z : 0.f };
+
+		std::vector<uint64_t> mortonCodes(nrPrimitives);
+		m_PrimitiveIndices.resize(nrPrimitives);
+		ParallelForRanges(nrPrimitives, 4096, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i{ begin }; i < end; ++i)
+				{
+					const Vector3 offset{ m_Centroids[i] - centroidBounds.min };
+					mortonCodes[i] = ExpandMortonBits(static_cast<uint64_t>(offset.x * scale.x)) << 2
+						| ExpandMortonBits(static_cast<uint64_t>(offset.y * scale.y)) << 1
+						| ExpandMortonBits(static_cast<uint64_t>(offset.z * scale.z));
+					m_PrimitiveIndices[i] = i;
+				}
+			});
+
+		RadixSort(mortonCodes, m_PrimitiveIndices, nrMortonBits);
+
+		//Karras' method: every internal node finds its key range and split on its own, so all of them are emitted in parallel
+		//Internal node i covers a range that starts or ends at key i, its children split the range after key split
+		//Equal codes are told apart by their position, so every key is unique
+		const auto commonPrefix{ [&](int i, int j) -> int
+			{
+				if (j < 0 || j >= static_cast<int>(nrPrimitives))
+					return -1;
+				if (mortonCodes[i] == mortonCodes[j])
+					return 64 + std::countl_zero(static_cast<uint32_t>(i ^ j));
+				return std::countl_zero(mortonCodes[i] ^ mortonCodes[j]);
+			} };
+
+		struct LinearNode
+		{
+			uint32_t first;
+			uint32_t last;
+			uint32_t split;
+		};
+		std::vector<LinearNode> linearNodes(nrPrimitives - 1);
+		ParallelForRanges(nrPrimitives - 1, 4096, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				for (int i{ static_cast<int>(begin) }; i < static_cast<int>(end); ++i)
+				{
+					//Grow the range towards the neighbour that shares the longer prefix
+					const int direction{ commonPrefix(i, i + 1) > commonPrefix(i, i - 1) ? 1 : -1 };
+					const int minPrefix{ commonPrefix(i, i - direction) };
+
+					int maxLength{ 2 };
+					while (commonPrefix(i, i + maxLength * direction) > minPrefix)
+						maxLength *= 2;
+
+					int length{};
+					for (int step{ maxLength / 2 }; step >= 1; step /= 2)
+					{
+						if (commonPrefix(i, i + (length + step) * direction) > minPrefix)
+							length += step;
+					}
+					const int j{ i + length * direction };
+
+					//Binary search for the last key that shares more than the prefix of the whole range
+					const int nodePrefix{ commonPrefix(i, j) };
+					int split{};
+					for (int divisor{ 2 }; ; divisor *= 2)
+					{
+						const int step{ (length + divisor - 1) / divisor };
+						if (commonPrefix(i, i + (split + step) * direction) > nodePrefix)
+							split += step;
+						if (step <= 1)
+							break;
+					}
+
+					linearNodes[i].first = static_cast<uint32_t>(std::min(i, j));
+					linearNodes[i].last = static_cast<uint32_t>(std::max(i, j));
+					linearNodes[i].split = static_cast<uint32_t>(i + split * direction + std::min(direction, 0));
+				}
+			});
+
+		//Relabel depth first into the node layout the rest of the BVH relies on: siblings next to each other, after their parent
+		m_Nodes.reserve(2 * size_t(nrPrimitives) - 1);
+		m_Nodes.push_back({});
+
+		struct RelabelTask
+		{
+			uint32_t nodeIndex;
+			uint32_t first;
+			uint32_t last;
+			int depth;
+		};
+		std::vector<RelabelTask> tasks{ { 0, 0, nrPrimitives - 1, 1 } };
+
+		while (!tasks.empty())
+		{
+			const RelabelTask task{ tasks.back() };
+			tasks.pop_back();
+
+			//The sorted primitives of a subtree are contiguous, so any subtree can be cut off into one leaf
+			const uint32_t count{ task.last - task.first + 1 };
+			if (count <= m_MaxLinearLeafSize || task.depth >= MaxDepth)
+			{
+				m_Nodes[task.nodeIndex].leftFirst = task.first;
+				m_Nodes[task.nodeIndex].primitiveCount = count;
+				continue;
+			}
+
+			const LinearNode& firstNode{ linearNodes[task.first] };
+			const uint32_t owner{ firstNode.first == task.first && firstNode.last == task.last ? task.first : task.last };
+			const uint32_t split{ linearNodes[owner].split };
+
+			const uint32_t leftChildIndex{ static_cast<uint32_t>(m_Nodes.size()) };
+			m_Nodes[task.nodeIndex].leftFirst = leftChildIndex;
+			m_Nodes[task.nodeIndex].primitiveCount = 0;
+			m_Nodes.push_back({});
+			m_Nodes.push_back({});
+
+			tasks.push_back({ leftChildIndex, task.first, split, task.depth + 1 });
+			tasks.push_back({ leftChildIndex + 1, split + 1, task.last, task.depth + 1 });
+		}
+
+		//Bounds are only known once the layout is, a refit fills them in bottom-up
+		Refit(primitiveBounds);
+		m_BuildCost = m_Cost;
+	}
+
+	void BVH::BuildFromTriangles(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		CalculateTriangleBounds(positions, indices);
+		Build(m_TriangleBounds);
+	}
+
+	void BVH::Clear()
+	{
+		m_Nodes.clear();
+		m_PrimitiveIndices.clear();
+		m_TopologyVersion = s_NextTopologyVersion++;
+		m_BuildCost = 0.f;
+		m_Cost = 0.f;
+	}
+
+	void BVH::Assign(std::vector<BVHNode> nodes, std::vector<uint32_t> primitiveIndices)
+	{
+		m_Nodes = std::move(nodes);
+		m_PrimitiveIndices = std::move(primitiveIndices);
+		m_TopologyVersion = s_NextTopologyVersion++;
+		m_BuildCost = CalculateCost();
+		m_Cost = m_BuildCost;
+	}
+
+	void BVH::Refit(const std::vector<AABB>& primitiveBounds)
+	{
+		//Children are always stored after their parent, so walking backwards visits them first
+		for (size_t i{ m_Nodes.size() }; i-- > 0;)
+		{
+			BVHNode& node{ m_Nodes[i] };
+			if (node.IsLeaf())
+			{
+				UpdateNodeBounds(node, primitiveBounds);
+				continue;
+			}
+
+			const BVHNode& left{ m_Nodes[node.leftFirst] };
+			const BVHNode& right{ m_Nodes[node.leftFirst + 1] };
+			node.minAABB = Vector3::Min(left.minAABB, right.minAABB);
+			node.maxAABB = Vector3::Max(left.maxAABB, right.maxAABB);
+		}
+
+		m_Cost = CalculateCost();
+	}
+
+	void BVH::Update(const std::vector<AABB>& primitiveBounds)
+	{
+		if (m_Nodes.empty() || primitiveBounds.size() != m_PrimitiveIndices.size())
+		{
+			Build(primitiveBounds);
+			return;
+		}
+
+		Refit(primitiveBounds);
+		if (GetCostRatio() > m_RebuildThreshold)
+			Build(primitiveBounds);
+	}
+
+	void BVH::UpdateFromTriangles(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		CalculateTriangleBounds(positions, indices);
+		Update(m_TriangleBounds);
+	}
+
+	float BVH::CalculateCost() const
+	{
+		if (m_Nodes.empty())
+			return 0.f;
+
+		//Traversing a node and intersecting a primitive are weighted the same
+		constexpr float traversalCost{ 1.f };
+		constexpr float intersectionCost{ 1.f };
+
+		float cost{};
+		for (const BVHNode& node : m_Nodes)
+		{
+			const float area{ AABB{ node.minAABB, node.maxAABB }.Area() };
+			cost += node.IsLeaf() ? area * node.primitiveCount * intersectionCost : area * traversalCost;
+		}
+
+		const float rootArea{ AABB{ m_Nodes[0].minAABB, m_Nodes[0].maxAABB }.Area() };
+		return rootArea > 0.f ? cost / rootArea : cost;
+	}
+
+	AABB BVH::GetBounds() const
+	{
+		if (m_Nodes.empty())
+			return {};
+
+		return { m_Nodes[0].minAABB, m_Nodes[0].maxAABB };
+	}
+
+	void BVH::CalculateTriangleBounds(const std::vector<Vector3>& positions, const std::vector<int>& indices)
+	{
+		m_TriangleBounds.resize(indices.size() / 3);
+		for (size_t i{}; i < m_TriangleBounds.size(); ++i)
+		{
+			AABB bounds{};
+			bounds.Grow(positions[indices[i * 3]]);
+			bounds.Grow(positions[indices[i * 3 + 1]]);
+			bounds.Grow(positions[indices[i * 3 + 2]]);
+			m_TriangleBounds[i] = bounds;
+		}
+	}
+
+	void BVH::UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds) const
+	{
+		AABB bounds{};
+		for (uint32_t i{}; i < node.primitiveCount; ++i)
+		{
+			bounds.Grow(primitiveBounds[m_PrimitiveIndices[node.leftFirst + i]]);
+		}
+		node.minAABB = bounds.min;
+		node.maxAABB = bounds.max;
+	}
+
+	float BVH::FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, int& axis, float& splitPosition) const
+	{
+		float bestCost{ FLT_MAX };
+		for (int currentAxis{}; currentAxis < 3; ++currentAxis)
+		{
+			//Bins are spread over the centroid bounds, not the node bounds
+			float boundsMin{ FLT_MAX };
+			float boundsMax{ -FLT_MAX };
+			for (uint32_t i{}; i < node.primitiveCount; ++i)
+			{
+				const float centroid{ m_Centroids[m_PrimitiveIndices[node.leftFirst + i]][currentAxis] };
+				boundsMin = std::min(boundsMin, centroid);
+				boundsMax = std::max(boundsMax, centroid);
+			}
+			if (boundsMin == boundsMax)
+				continue;
+
+			AABB binBounds[m_NrBins]{};
+			uint32_t binCounts[m_NrBins]{};
+			const float scale{ m_NrBins / (boundsMax - boundsMin) };
+			for (uint32_t i{}; i < node.primitiveCount; ++i)
+			{
+				const uint32_t primitiveIndex{ m_PrimitiveIndices[node.leftFirst + i] };
+				const int binIndex{ std::min(m_NrBins - 1, static_cast<int>((m_Centroids[primitiveIndex][currentAxis] - boundsMin) * scale)) };
+				++binCounts[binIndex];
+				binBounds[binIndex].Grow(primitiveBounds[primitiveIndex]);
+			}
+
+			//Sweep from both sides to get the area and count left and right of every bin boundary
+			float leftAreas[m_NrBins - 1]{};
+			float rightAreas[m_NrBins - 1]{};
+			uint32_t leftCounts[m_NrBins - 1]{};
+			uint32_t rightCounts[m_NrBins - 1]{};
+			AABB leftBox{};
+			AABB rightBox{};
+			uint32_t leftSum{};
+			uint32_t rightSum{};
+			for (int i{}; i < m_NrBins - 1; ++i)
+			{
+				leftSum += binCounts[i];
+				leftCounts[i] = leftSum;
+				leftBox.Grow(binBounds[i]);
+				leftAreas[i] = leftBox.Area();
+
+				rightSum += binCounts[m_NrBins - 1 - i];
+				rightCounts[m_NrBins - 2 - i] = rightSum;
+				rightBox.Grow(binBounds[m_NrBins - 1 - i]);
+				rightAreas[m_NrBins - 2 - i] = rightBox.Area();
+			}
+
+			const float binWidth{ (boundsMax - boundsMin) / m_NrBins };
+			for (int i{}; i < m_NrBins - 1; ++i)
+			{
+				if (leftCounts[i] == 0 || rightCounts[i] == 0)
+					continue;
+
+				const float cost{ leftCounts[i] * leftAreas[i] + rightCounts[i] * rightAreas[i] };
+				if (cost < bestCost)
+				{
+					axis = currentAxis;
+					splitPosition = boundsMin + binWidth * (i + 1);
+					bestCost = cost;
+				}
+			}
+		}
+		return bestCost;
+	}
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Maths.h"
+
+namespace dae
+{
+	struct AABB
+	{
+		Vector3 min{ FLT_MAX, FLT_MAX, FLT_MAX };
+		Vector3 max{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+		void Grow(const Vector3& point)
+		{
+			min = Vector3::Min(min, point);
+			max = Vector3::Max(max, point);
+		}
+
+		void Grow(const AABB& other)
+		{
+			min = Vector3::Min(min, other.min);
+			max = Vector3::Max(max, other.max);
+		}
+
+		bool IsEmpty() const
+		{
+			return max.x < min.x || max.y < min.y || max.z < min.z;
+		}
+
+		//Half of the surface area, the factor 2 cancels out in every SAH comparison
+		float Area() const
+		{
+			if (IsEmpty())
+				return 0.f;
+
+			const Vector3 extent{ max - min };
+			return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+		}
+
+		Vector3 Center() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		//Bounds of the eight transformed corners
+		AABB Transformed(const Matrix& transform) const
+		{
+			AABB transformed{};
+			for (int corner{}; corner < 8; ++corner)
+			{
+				transformed.Grow(transform.TransformPoint(
+					corner & 1 ? max.x : min.x,
+					corner & 2 ? max.y : min.y,
+					corner & 4 ? max.z : min.z));
+			}
+			return transformed;
+		}
+	};
+
+	struct BVHNode
+	{
+		Vector3 minAABB{};
+		//interior node: index of the left child (right child is leftFirst + 1)
+		//leaf node: index of the first primitive in the primitive index list
+		uint32_t leftFirst{};
+		Vector3 maxAABB{};
+		uint32_t primitiveCount{};
+
+		bool IsLeaf() const { return primitiveCount > 0; }
+	};
+
+	enum class BVHBuildMode
+	{
+		//Binned surface area heuristic, slowest to build but the cheapest tree to traverse
+		SAH,
+		//Primitives sorted along a Morton curve, built in parallel in a fraction of the SAH time
+		Linear
+	};
+
+	//Binary bounding volume hierarchy built with the surface area heuristic (binned) or as a linear BVH
+	//The BVH only knows about primitive bounds, the owner maps primitive indices back to its own geometry
+	class BVH final
+	{
+	public:
+		//Traversal stacks are sized with this, the builders never create a deeper tree
+		static constexpr int MaxDepth{ 64 };
+
+		//Used by every following (re)build, including the ones Update triggers
+		void SetBuildMode(BVHBuildMode buildMode) { m_BuildMode = buildMode; }
+		BVHBuildMode GetBuildMode() const { return m_BuildMode; }
+
+		void Build(const std::vector<AABB>& primitiveBounds);
+		void BuildFromTriangles(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+		void Clear();
+		//Takes over a tree that was built before, e.g. one read from a mesh cache
+		void Assign(std::vector<BVHNode> nodes, std::vector<uint32_t> primitiveIndices);
+
+		//Recomputes the node bounds bottom-up for primitives that moved, the topology stays the same
+		void Refit(const std::vector<AABB>& primitiveBounds);
+
+		//Refits when the primitive count is unchanged, rebuilds when it changed or when the refitted
+		//tree got more expensive than the rebuild threshold allows compared to the last full build
+		void Update(const std::vector<AABB>& primitiveBounds);
+		void UpdateFromTriangles(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+
+		//SAH cost of the whole tree relative to the area of the root
+		float CalculateCost() const;
+		float GetCostRatio() const { return m_BuildCost > 0.f ? m_Cost / m_BuildCost : 1.f; }
+		void SetRebuildThreshold(float costRatio) { m_RebuildThreshold = costRatio; }
+
+		bool IsEmpty() const { return m_Nodes.empty(); }
+		AABB GetBounds() const;
+
+		const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+		//Changes with every build, clear or assign, but not with a refit, unique over all trees
+		uint64_t GetTopologyVersion() const { return m_TopologyVersion; }
+
+	private:
+		static constexpr int m_NrBins{ 16 };
+		//Linear BVH subtrees with this many primitives or less become a single leaf
+		static constexpr uint32_t m_MaxLinearLeafSize{ 4 };
+
+		BVHBuildMode m_BuildMode{ BVHBuildMode::SAH };
+
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<uint32_t> m_PrimitiveIndices{};
+		std::vector<Vector3> m_Centroids{};
+		std::vector<AABB> m_TriangleBounds{};
+
+		uint64_t m_TopologyVersion{};
+		float m_BuildCost{};
+		float m_Cost{};
+		float m_RebuildThreshold{ 1.5f };
+
+		void BuildSAH(const std::vector<AABB>& primitiveBounds);
+		void BuildLinear(const std::vector<AABB>& primitiveBounds);
+
+		void CalculateTriangleBounds(const std::vector<Vector3>& positions, const std::vector<int>& indices);
+
+		void UpdateNodeBounds(BVHNode& node, const std::vector<AABB>& primitiveBounds) const;
+		float FindBestSplit(const BVHNode& node, const std::vector<AABB>& primitiveBounds, int& axis, float& splitPosition) const;
+	};
+}
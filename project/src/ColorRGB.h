@@ -74,7 +74,7 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator/(const ColorRGB& c) const
+		ColorRGB operator/(const ColorRGB& c) const
 		{
 			return { r / c.r, g / c.g, b / c.b };
 		}
@@ -102,7 +102,7 @@ namespace dae
 			return *this;
 		}
 
-		const ColorRGB& operator/(float s) const
+		ColorRGB operator/(float s) const
 		{
 			return { r / s, g / s, b / s };
 		}
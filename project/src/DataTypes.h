@@ -3,6 +3,9 @@
 #include <vector>
 
 #include "Maths.h"
+#include "BVH.h"
+#include "MeshKernels.h"
+#include "WideBVH.h"
 
 
 namespace dae
@@ -24,6 +27,15 @@ namespace dae
 		unsigned char materialIndex{ 0 };
 	};
 
+	//Everything the intersection kernel needs of one triangle, stored contiguously so no vertex has to be gathered
+	struct TriangleRecord
+	{
+		Vector3 v0{};
+		Vector3 edge1{};
+		Vector3 edge2{};
+		Vector3 normal{};
+	};
+
 	enum class TriangleCullMode
 	{
 		FrontFaceCulling,
@@ -55,6 +67,20 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	struct TextureCoordinate
+	{
+		float u{};
+		float v{};
+	};
+
+	enum class TriangleMeshTransformMode
+	{
+		//Rigid transforms: rays are moved into object space, vertices and BVH never change after a transform update
+		ObjectSpace,
+		//Deforming meshes: every vertex is transformed and the BVH refitted on each transform update
+		WorldSpace
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -79,21 +105,43 @@ namespace dae
 		std::vector<int> indices{};
 		unsigned char materialIndex{};
 
+		//Object space attributes per vertex, indexed like positions, empty when the mesh was not loaded with them
+		//Shading still uses the triangle normals
+		std::vector<Vector3> vertexNormals{};
+		std::vector<TextureCoordinate> uvs{};
+
 		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+		TriangleMeshTransformMode transformMode{ TriangleMeshTransformMode::ObjectSpace };
 
 		Matrix rotationTransform{};
 		Matrix translationTransform{};
 		Matrix scaleTransform{};
 
+		//Object to world and back, the inverse is only kept in ObjectSpace mode
+		//In WorldSpace mode worldTransform is what the transformed vertices were made with, so the scene version still sees the mesh move
+		Matrix worldTransform{};
+		Matrix inverseTransform{};
+
 		Vector3 minAABB;
 		Vector3 maxAABB;
 
 		Vector3 transformedMinAABB;
 		Vector3 transformedMaxAABB;
 
+		//Only filled in WorldSpace mode
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
 
+		//Built from positions (ObjectSpace) or transformedPositions (WorldSpace), triangle i starts at indices[i * 3]
+		std::vector<TriangleRecord> triangles{};
+
+		//Built over the same positions as triangles, primitive i is triangle i
+		BVH bvh{};
+		//Collapsed from bvh after every build and refitted with it, this is the one that gets traversed
+		WideBVH wideBVH{};
+		//Space the triangles and BVH were last built in, switching transformMode rebuilds them
+		TriangleMeshTransformMode bvhTransformMode{ TriangleMeshTransformMode::ObjectSpace };
+
 		void Translate(const Vector3& translation)
 		{
 			translationTransform = Matrix::CreateTranslation(translation);
@@ -130,24 +178,7 @@ namespace dae
 
 		void CalculateNormals()
 		{
-			
-			normals.clear();
-			normals.reserve(indices.size()/3);
-			for (size_t i{}; i < indices.size(); i+=3)
-			{
-				Vector3 v0{positions[indices[i]]};
-				Vector3 v1{ positions[indices[i+1]] };
-				Vector3 v2{ positions[indices[i+2]] };
-
-				Vector3 e1{ v1 - v0 };
-				Vector3 e2{ v2 - v0 };
-
-				Vector3 normal = Vector3::Cross(e1, e2);
-				normal.Normalized();
-				normals.emplace_back(normal);
-			}
-			//throw std::runtime_error("Not Implemented Yet");
-
+			CalculateTriangleNormals(positions, indices, normals);
 		}
 
 		void UpdateTransforms()
@@ -157,22 +188,88 @@ namespace dae
 			const Matrix finalTransform{ scaleTransform * rotationTransform * translationTransform };
 			//const Matrix finalTransform{ translationTransform };
 
-			transformedPositions.clear();
-			//changed the type of for loop from an indexed to a ranged based so reserve could be used instead of resize
-			transformedPositions.reserve(positions.size());
-			for (const auto& pos : positions)
+			if (transformMode == TriangleMeshTransformMode::ObjectSpace)
+			{
+				worldTransform = finalTransform;
+				inverseTransform = Matrix::Inverse(finalTransform);
+
+				//The object space triangles and BVH only have to change when triangles were added or removed, or still hold world space vertices
+				if (bvhTransformMode != TriangleMeshTransformMode::ObjectSpace || triangles.size() != indices.size() / 3)
+					RebuildBVH();
+
+				UpdateTransformedAABB(finalTransform);
+				return;
+			}
+
+			//A BVH over object space vertices is rebuilt once instead of refitted into a poor tree
+			if (bvhTransformMode != TriangleMeshTransformMode::WorldSpace)
 			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(pos));
-				//transformedPositions.emplace_back(pos);
+				RebuildBVH();
+				return;
 			}
-			transformedNormals.clear();
-			transformedNormals.reserve(normals.size());
-			for (const auto& normal : normals)
+
+			TransformToWorldSpace(finalTransform);
+
+			//Refit after the vertices moved, the BVH only rebuilds when the refitted tree degraded too much
+			bvh.UpdateFromTriangles(transformedPositions, indices);
+			UpdateFromWorldSpaceBVH();
+		}
+
+		//WorldSpace mode only, moves the vertices and rebuilds the triangle records, the BVH is left to the caller
+		void TransformToWorldSpace(const Matrix& finalTransform)
+		{
+			worldTransform = finalTransform;
+
+			//Parallel and SIMD, the buffers keep their memory from the previous update
+			TransformPoints(finalTransform, positions, transformedPositions);
+			TransformVectors(finalTransform, normals, transformedNormals);
+
+			BuildTriangleRecords(transformedPositions, transformedNormals, indices, triangles);
+		}
+
+		//Linear builds are much faster for big meshes, SAH gives the faster tree to trace
+		void SetBVHBuildMode(BVHBuildMode buildMode)
+		{
+			bvh.SetBuildMode(buildMode);
+			RebuildBVH();
+		}
+
+		//Call after editing positions or indices in place without changing the triangle count
+		void RebuildBVH()
+		{
+			if (transformMode == TriangleMeshTransformMode::WorldSpace)
 			{
-				transformedNormals.emplace_back(finalTransform.TransformVector(normal));
-				//transformedNormals.emplace_back(normal);
+				TransformToWorldSpace(scaleTransform * rotationTransform * translationTransform);
+				bvh.BuildFromTriangles(transformedPositions, indices);
+				UpdateFromWorldSpaceBVH();
+				return;
 			}
-			UpdateTransformedAABB(finalTransform);
+
+			bvh.BuildFromTriangles(positions, indices);
+			UpdateFromBVH();
+		}
+
+		//Sets up the triangles, wide BVH and bounds for an object space bvh that was just built or assigned
+		void UpdateFromBVH()
+		{
+			BuildTriangleRecords(positions, normals, indices, triangles);
+			wideBVH.Build(bvh);
+			bvhTransformMode = TriangleMeshTransformMode::ObjectSpace;
+			const AABB bounds{ bvh.GetBounds() };
+			minAABB = bounds.min;
+			maxAABB = bounds.max;
+			UpdateTransformedAABB(worldTransform);
+		}
+
+		//Same for a WorldSpace bvh that was just built or refitted over transformedPositions
+		void UpdateFromWorldSpaceBVH()
+		{
+			//Only collapses again when the refit turned into a rebuild
+			wideBVH.Update(bvh);
+			bvhTransformMode = TriangleMeshTransformMode::WorldSpace;
+			const AABB bounds{ bvh.GetBounds() };
+			transformedMinAABB = bounds.min;
+			transformedMaxAABB = bounds.max;
 		}
 
 		void UpdateAABB()
@@ -195,36 +292,111 @@ namespace dae
 			//(xmax,ymin,zmin)
 			Vector3 tAABB{ finalTransform.TransformPoint(maxAABB.x,minAABB.y,minAABB.z) };
 			tminAABB = Vector3::Min(tAABB, tminAABB);
-			tminAABB = Vector3::Max(tAABB, tmaxAABB);			
+			tmaxAABB = Vector3::Max(tAABB, tmaxAABB);			
 			//(xmax,ymin,zmax)
 			tAABB= finalTransform.TransformPoint(maxAABB.x,minAABB.y,maxAABB.z) ;
 			tminAABB = Vector3::Min(tAABB, tminAABB);
-			tminAABB = Vector3::Max(tAABB, tmaxAABB);			
+			tmaxAABB = Vector3::Max(tAABB, tmaxAABB);			
 			//(xmin,ymin,zmax)
 			tAABB= finalTransform.TransformPoint(minAABB.x,minAABB.y,maxAABB.z) ;
 			tminAABB = Vector3::Min(tAABB, tminAABB);
-			tminAABB = Vector3::Max(tAABB, tmaxAABB);			
+			tmaxAABB = Vector3::Max(tAABB, tmaxAABB);			
 			//(xmin,ymax,zmin)
 			tAABB= finalTransform.TransformPoint(minAABB.x,maxAABB.y,minAABB.z);
 			tminAABB = Vector3::Min(tAABB, tminAABB);
-			tminAABB = Vector3::Max(tAABB, tmaxAABB);			
+			tmaxAABB = Vector3::Max(tAABB, tmaxAABB);			
 			//(xmax,ymax,zmin)
 			tAABB= finalTransform.TransformPoint(maxAABB.x,maxAABB.y,minAABB.z);
 			tminAABB = Vector3::Min(tAABB, tminAABB);
-			tminAABB = Vector3::Max(tAABB, tmaxAABB);			
+			tmaxAABB = Vector3::Max(tAABB, tmaxAABB);			
 			//(xmax,ymax,zmax)
 			tAABB= finalTransform.TransformPoint(maxAABB.x,maxAABB.y,maxAABB.z);
 			tminAABB = Vector3::Min(tAABB, tminAABB);
-			tminAABB = Vector3::Max(tAABB, tmaxAABB);			
+			tmaxAABB = Vector3::Max(tAABB, tmaxAABB);			
 			//(xmin,ymax,zmax)
 			tAABB= finalTransform.TransformPoint(minAABB.x,maxAABB.y,maxAABB.z);
 			tminAABB = Vector3::Min(tAABB, tminAABB);
-			tminAABB = Vector3::Max(tAABB, tmaxAABB);
+			tmaxAABB = Vector3::Max(tAABB, tmaxAABB);
 
 			transformedMinAABB = tminAABB;
 			transformedMaxAABB = tmaxAABB;
 		}
 	};
+
+	//Immutable triangle data with its object space BVH, shared by every instance that places it in a scene
+	struct MeshGeometry
+	{
+		MeshGeometry(const std::vector<Vector3>& _positions, const std::vector<Vector3>& _normals, const std::vector<int>& _indices) :
+			positions(_positions), normals(_normals), indices(_indices)
+		{
+			if (normals.size() != indices.size() / 3)
+				CalculateTriangleNormals(positions, indices, normals);
+
+			BuildTriangleRecords(positions, normals, indices, triangles);
+			bvh.BuildFromTriangles(positions, indices);
+			wideBVH.Build(bvh);
+			bounds = bvh.GetBounds();
+		}
+
+		//Copies a mesh whose object space BVH is already built, e.g. one loaded through a mesh cache
+		explicit MeshGeometry(const TriangleMesh& mesh) :
+			positions(mesh.positions), normals(mesh.normals), indices(mesh.indices), triangles(mesh.triangles), bvh(mesh.bvh), wideBVH(mesh.wideBVH)
+		{
+			bounds = bvh.GetBounds();
+		}
+
+		std::vector<Vector3> positions{};
+		std::vector<Vector3> normals{};
+		std::vector<int> indices{};
+		std::vector<TriangleRecord> triangles{};
+
+		BVH bvh{};
+		WideBVH wideBVH{};
+		AABB bounds{};
+	};
+
+	//One placement of a MeshGeometry, only the transform and material are stored per instance
+	struct TriangleMeshInstance
+	{
+		const MeshGeometry* pGeometry{ nullptr };
+		unsigned char materialIndex{};
+		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+
+		Matrix rotationTransform{};
+		Matrix translationTransform{};
+		Matrix scaleTransform{};
+
+		Matrix worldTransform{};
+		Matrix inverseTransform{};
+
+		Vector3 transformedMinAABB{};
+		Vector3 transformedMaxAABB{};
+
+		void Translate(const Vector3& translation)
+		{
+			translationTransform = Matrix::CreateTranslation(translation);
+		}
+
+		void RotateY(float yaw)
+		{
+			rotationTransform = Matrix::CreateRotationY(yaw);
+		}
+
+		void Scale(const Vector3& scale)
+		{
+			scaleTransform = Matrix::CreateScale(scale);
+		}
+
+		void UpdateTransforms()
+		{
+			worldTransform = scaleTransform * rotationTransform * translationTransform;
+			inverseTransform = Matrix::Inverse(worldTransform);
+
+			const AABB worldBounds{ pGeometry->bounds.Transformed(worldTransform) };
+			transformedMinAABB = worldBounds.min;
+			transformedMaxAABB = worldBounds.max;
+		}
+	};
 #pragma endregion
 #pragma region LIGHT
 	enum class LightType
@@ -253,11 +425,34 @@ namespace dae
 		float max{ FLT_MAX };
 	};
 
+	//Bundle of camera rays for neighbouring pixels, they all share the origin
+	//Directions are stored per axis so every ray of the packet can be tested against one primitive in a single loop
+	struct RayPacket
+	{
+		static constexpr int MaxSize{ 64 };
+
+		Vector3 origin{};
+		float directionX[MaxSize];
+		float directionY[MaxSize];
+		float directionZ[MaxSize];
+
+		float min{ 0.0001f };
+		float max[MaxSize];
+
+		int size{};
+
+		Vector3 GetDirection(int index) const { return { directionX[index], directionY[index], directionZ[index] }; }
+		Ray GetRay(int index) const { return { origin, GetDirection(index), min, max[index] }; }
+	};
+
 	struct HitRecord
 	{
 		Vector3 origin{};
 		Vector3 normal{};
 		float t = FLT_MAX;
+		//Barycentric weights of v1 and v2 for triangle hits, v0 gets 1 - u - v
+		float u{};
+		float v{};
 
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
@@ -0,0 +1,190 @@
+#include "FrameBuffer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace dae
+{
+	//Gamma is looked up instead of computed, pow has no SIMD instruction
+	//Linear values are quantized to 4096 steps, fine enough that no 8-bit output level is skipped
+	static constexpr int GammaTableSize{ 4096 };
+
+	static const std::array<uint32_t, GammaTableSize>& GetGammaTable()
+	{
+		static const std::array<uint32_t, GammaTableSize> gammaTable{ []
+			{
+				std::array<uint32_t, GammaTableSize> table{};
+				for (int i{}; i < GammaTableSize; ++i)
+				{
+					const float linear{ static_cast<float>(i) / (GammaTableSize - 1) };
+					const float encoded{ linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.f / 2.4f) - 0.055f };
+					table[i] = static_cast<uint32_t>(std::clamp(encoded, 0.f, 1.f) * 255.f + .5f);
+				}
+				return table;
+			}() };
+		return gammaTable;
+	}
+
+	static float ToneMapChannel(float value, ToneMapping toneMapping)
+	{
+		switch (toneMapping)
+		{
+		case ToneMapping::Reinhard:
+			return value / (1.f + value);
+		case ToneMapping::ACES:
+			return (value * (2.51f * value + .03f)) / (value * (2.43f * value + .59f) + .14f);
+		default:
+			//MaxToOne is applied to the whole color before this, Clamp is done by the caller
+			return value;
+		}
+	}
+
+	static uint32_t EncodeChannel(float value, bool gammaCorrection)
+	{
+		//max before min, so a NaN ends up as 0 like in the AVX2 kernel
+		value = std::min(std::max(value, 0.f), 1.f);
+		if (gammaCorrection)
+			return GetGammaTable()[static_cast<int>(value * (GammaTableSize - 1))];
+		return static_cast<uint32_t>(value * 255);
+	}
+
+	void FrameBuffer::Resize(int width, int height)
+	{
+		m_Width = width;
+		m_Height = height;
+		const size_t nrPixels{ static_cast<size_t>(width) * height };
+		m_Red.assign(nrPixels, 0.f);
+		m_Green.assign(nrPixels, 0.f);
+		m_Blue.assign(nrPixels, 0.f);
+	}
+
+	void FrameBuffer::Clear()
+	{
+		std::fill(m_Red.begin(), m_Red.end(), 0.f);
+		std::fill(m_Green.begin(), m_Green.end(), 0.f);
+		std::fill(m_Blue.begin(), m_Blue.end(), 0.f);
+	}
+
+	void FrameBuffer::Resolve(uint32_t* pPixels, int firstPixel, int nrPixels, const ResolveSettings& settings) const
+	{
+		Resolve(pPixels, firstPixel, nrPixels, settings, GetSupportedSimdLevel());
+	}
+
+	void FrameBuffer::Resolve(uint32_t* pPixels, int firstPixel, int nrPixels, const ResolveSettings& settings, SimdLevel simdLevel) const
+	{
+		const float* pRed{ m_Red.data() + firstPixel };
+		const float* pGreen{ m_Green.data() + firstPixel };
+		const float* pBlue{ m_Blue.data() + firstPixel };
+		uint32_t* pTarget{ pPixels + firstPixel };
+
+		if (std::min(simdLevel, GetSupportedSimdLevel()) == SimdLevel::AVX2)
+			ResolvePixels_AVX2(pRed, pGreen, pBlue, pTarget, nrPixels, settings);
+		else
+			ResolvePixels_Scalar(pRed, pGreen, pBlue, pTarget, nrPixels, settings);
+	}
+
+	void ResolvePixels_Scalar(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, int nrPixels, const ResolveSettings& settings)
+	{
+		const PixelLayout& layout{ settings.layout };
+		for (int i{}; i < nrPixels; ++i)
+		{
+			float red{ pRed[i] * settings.scale };
+			float green{ pGreen[i] * settings.scale };
+			float blue{ pBlue[i] * settings.scale };
+
+			if (settings.toneMapping == ToneMapping::MaxToOne)
+			{
+				const float maxValue{ std::max(red, std::max(green, blue)) };
+				const float divisor{ maxValue > 1.f ? maxValue : 1.f };
+				red /= divisor;
+				green /= divisor;
+				blue /= divisor;
+			}
+
+			pPixels[i] = EncodeChannel(ToneMapChannel(red, settings.toneMapping), settings.gammaCorrection) << layout.redShift |
+				EncodeChannel(ToneMapChannel(green, settings.toneMapping), settings.gammaCorrection) << layout.greenShift |
+				EncodeChannel(ToneMapChannel(blue, settings.toneMapping), settings.gammaCorrection) << layout.blueShift |
+				layout.alphaMask;
+		}
+	}
+
+#if defined(DAE_X86)
+	DAE_TARGET("avx2")
+	static __m256 ToneMapChannel_AVX2(__m256 value, ToneMapping toneMapping)
+	{
+		const __m256 one{ _mm256_set1_ps(1.f) };
+		switch (toneMapping)
+		{
+		case ToneMapping::Reinhard:
+			return _mm256_div_ps(value, _mm256_add_ps(one, value));
+		case ToneMapping::ACES:
+		{
+			const __m256 numerator{ _mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.51f), value), _mm256_set1_ps(.03f))) };
+			const __m256 denominator{ _mm256_add_ps(_mm256_mul_ps(value, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), value), _mm256_set1_ps(.59f))), _mm256_set1_ps(.14f)) };
+			return _mm256_div_ps(numerator, denominator);
+		}
+		default:
+			return value;
+		}
+	}
+
+	DAE_TARGET("avx2")
+	static __m256i EncodeChannel_AVX2(__m256 value, bool gammaCorrection)
+	{
+		//max_ps returns its second operand for NaN
+		value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+		if (gammaCorrection)
+		{
+			const __m256i tableIndices{ _mm256_cvttps_epi32(_mm256_mul_ps(value, _mm256_set1_ps(static_cast<float>(GammaTableSize - 1)))) };
+			return _mm256_i32gather_epi32(reinterpret_cast<const int*>(GetGammaTable().data()), tableIndices, 4);
+		}
+		return _mm256_cvttps_epi32(_mm256_mul_ps(value, _mm256_set1_ps(255.f)));
+	}
+
+	DAE_TARGET("avx2")
+	void ResolvePixels_AVX2(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, int nrPixels, const ResolveSettings& settings)
+	{
+		const PixelLayout& layout{ settings.layout };
+		const __m128i redShift{ _mm_cvtsi32_si128(layout.redShift) };
+		const __m128i greenShift{ _mm_cvtsi32_si128(layout.greenShift) };
+		const __m128i blueShift{ _mm_cvtsi32_si128(layout.blueShift) };
+		const __m256i alphaMask{ _mm256_set1_epi32(static_cast<int>(layout.alphaMask)) };
+		const __m256 one{ _mm256_set1_ps(1.f) };
+		const __m256 scale{ _mm256_set1_ps(settings.scale) };
+
+		int i{};
+		for (; i + 8 <= nrPixels; i += 8)
+		{
+			__m256 red{ _mm256_mul_ps(_mm256_loadu_ps(pRed + i), scale) };
+			__m256 green{ _mm256_mul_ps(_mm256_loadu_ps(pGreen + i), scale) };
+			__m256 blue{ _mm256_mul_ps(_mm256_loadu_ps(pBlue + i), scale) };
+
+			if (settings.toneMapping == ToneMapping::MaxToOne)
+			{
+				const __m256 maxValue{ _mm256_max_ps(red, _mm256_max_ps(green, blue)) };
+				const __m256 divisor{ _mm256_blendv_ps(one, maxValue, _mm256_cmp_ps(maxValue, one, _CMP_GT_OQ)) };
+				red = _mm256_div_ps(red, divisor);
+				green = _mm256_div_ps(green, divisor);
+				blue = _mm256_div_ps(blue, divisor);
+			}
+
+			const __m256i packed{ _mm256_or_si256(
+				_mm256_or_si256(_mm256_sll_epi32(EncodeChannel_AVX2(ToneMapChannel_AVX2(red, settings.toneMapping), settings.gammaCorrection), redShift),
+					_mm256_sll_epi32(EncodeChannel_AVX2(ToneMapChannel_AVX2(green, settings.toneMapping), settings.gammaCorrection), greenShift)),
+				_mm256_or_si256(_mm256_sll_epi32(EncodeChannel_AVX2(ToneMapChannel_AVX2(blue, settings.toneMapping), settings.gammaCorrection), blueShift),
+					alphaMask)) };
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pPixels + i), packed);
+		}
+
+		//Rows that are not a multiple of 8 pixels wide
+		ResolvePixels_Scalar(pRed + i, pGreen + i, pBlue + i, pPixels + i, nrPixels - i, settings);
+	}
+#else
+	//Never selected on other architectures, GetSupportedSimdLevel always reports Scalar there
+	void ResolvePixels_AVX2(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, int nrPixels, const ResolveSettings& settings)
+	{
+		ResolvePixels_Scalar(pRed, pGreen, pBlue, pPixels, nrPixels, settings);
+	}
+#endif
+}
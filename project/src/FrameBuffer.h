@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "ColorRGB.h"
+#include "Simd.h"
+
+namespace dae
+{
+	//How linear radiance is brought into [0, 1] before it is quantized
+	enum class ToneMapping
+	{
+		MaxToOne, //divides by the largest channel when it exceeds 1, keeps the hue
+		Clamp, //clamps every channel on its own
+		Reinhard, //c / (1 + c)
+		ACES //Narkowicz fit of the ACES filmic curve
+	};
+
+	//Where the 8-bit channels go in a 32-bit pixel, read once from the surface format
+	struct PixelLayout
+	{
+		int redShift{ 16 };
+		int greenShift{ 8 };
+		int blueShift{ 0 };
+		//set on every pixel, makes the pixels opaque in formats with alpha
+		uint32_t alphaMask{};
+	};
+
+	struct ResolveSettings
+	{
+		ToneMapping toneMapping{ ToneMapping::MaxToOne };
+		//sRGB encoding, the scenes were lit for linear output so it is off by default
+		bool gammaCorrection{ false };
+		PixelLayout layout{};
+		//1 / number of accumulated samples, turns the sums into the average
+		float scale{ 1.f };
+	};
+
+	//Linear float radiance per pixel, one array per channel so the resolve pass reads 8 pixels per load
+	//Holds the sum of every sample when frames are accumulated
+	class FrameBuffer final
+	{
+	public:
+		void Resize(int width, int height);
+		void Clear();
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+
+		void SetPixel(int pixelIndex, const ColorRGB& color)
+		{
+			m_Red[pixelIndex] = color.r;
+			m_Green[pixelIndex] = color.g;
+			m_Blue[pixelIndex] = color.b;
+		}
+
+		void AddPixel(int pixelIndex, const ColorRGB& color)
+		{
+			m_Red[pixelIndex] += color.r;
+			m_Green[pixelIndex] += color.g;
+			m_Blue[pixelIndex] += color.b;
+		}
+
+		ColorRGB GetPixel(int pixelIndex) const
+		{
+			return { m_Red[pixelIndex], m_Green[pixelIndex], m_Blue[pixelIndex] };
+		}
+
+		//Tonemaps, encodes and packs the pixels in [firstPixel, firstPixel + nrPixels) into pPixels
+		void Resolve(uint32_t* pPixels, int firstPixel, int nrPixels, const ResolveSettings& settings) const;
+		void Resolve(uint32_t* pPixels, int firstPixel, int nrPixels, const ResolveSettings& settings, SimdLevel simdLevel) const;
+
+	private:
+		int m_Width{};
+		int m_Height{};
+		std::vector<float> m_Red{};
+		std::vector<float> m_Green{};
+		std::vector<float> m_Blue{};
+	};
+
+	//Both kernels produce the same bits, the AVX2 one handles 8 pixels per iteration
+	void ResolvePixels_Scalar(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, int nrPixels, const ResolveSettings& settings);
+	void ResolvePixels_AVX2(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pPixels, int nrPixels, const ResolveSettings& settings);
+}
@@ -0,0 +1,104 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const std::string& filename)
+	{
+		Close();
+
+#if defined(_WIN32)
+		const HANDLE fileHandle{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize{};
+		if (!GetFileSizeEx(fileHandle, &fileSize))
+		{
+			CloseHandle(fileHandle);
+			return false;
+		}
+
+		m_FileHandle = fileHandle;
+		m_Size = static_cast<size_t>(fileSize.QuadPart);
+		m_IsOpen = true;
+		//Mapping a file of 0 bytes fails
+		if (m_Size == 0)
+			return true;
+
+		m_MappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_MappingHandle)
+			m_pData = static_cast<const char*>(MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+		const int fileDescriptor{ open(filename.c_str(), O_RDONLY) };
+		if (fileDescriptor < 0)
+			return false;
+
+		struct stat fileStatus{};
+		if (fstat(fileDescriptor, &fileStatus) != 0)
+		{
+			close(fileDescriptor);
+			return false;
+		}
+
+		m_Size = static_cast<size_t>(fileStatus.st_size);
+		m_IsOpen = true;
+		if (m_Size != 0)
+		{
+			void* pMapping{ mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0) };
+			if (pMapping != MAP_FAILED)
+			{
+				//The whole file is read front to back
+				madvise(pMapping, m_Size, MADV_SEQUENTIAL);
+				m_pData = static_cast<const char*>(pMapping);
+			}
+		}
+		//The mapping stays valid after the descriptor is closed
+		close(fileDescriptor);
+		if (m_Size == 0)
+			return true;
+#endif
+
+		if (!m_pData)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#if defined(_WIN32)
+		if (m_pData)
+			UnmapViewOfFile(m_pData);
+		if (m_MappingHandle)
+			CloseHandle(m_MappingHandle);
+		if (m_FileHandle)
+			CloseHandle(m_FileHandle);
+		m_MappingHandle = nullptr;
+		m_FileHandle = nullptr;
+#else
+		if (m_pData)
+			munmap(const_cast<char*>(m_pData), m_Size);
+#endif
+		m_pData = nullptr;
+		m_Size = 0;
+		m_IsOpen = false;
+	}
+}
@@ -2,6 +2,7 @@
 #include "Maths.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
+#include "MaterialBatch.h"
 
 namespace dae
 {
@@ -24,7 +25,10 @@ namespace dae
 		 * \param v view direction
 		 * \return color
 		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const = 0;
+
+		//Parameters for the batch shaders, the renderer shades through these instead of Shade
+		virtual MaterialData GetData() const = 0;
 	};
 #pragma endregion
 
@@ -38,11 +42,16 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const override
 		{
 			return m_Color;
 		}
 
+		MaterialData GetData() const override
+		{
+			return { MaterialType::SolidColor, m_Color };
+		}
+
 	private:
 		ColorRGB m_Color{ colors::White };
 	};
@@ -57,13 +66,18 @@ namespace dae
 		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
 			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance) {}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const override
 		{
 			//todo: W3
 			//throw std::runtime_error("Not Implemented Yet");
 			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor);
 		}
 
+		MaterialData GetData() const override
+		{
+			return { MaterialType::Lambert, m_DiffuseColor, m_DiffuseReflectance };
+		}
+
 	private:
 		ColorRGB m_DiffuseColor{ colors::White };
 		float m_DiffuseReflectance{ 1.f }; //kd
@@ -82,7 +96,7 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const override
 		{
 			//todo: W3
 			//throw std::runtime_error("Not Implemented Yet");
@@ -90,6 +104,11 @@ namespace dae
 			//return {};
 		}
 
+		MaterialData GetData() const override
+		{
+			return { MaterialType::LambertPhong, m_DiffuseColor, m_DiffuseReflectance, m_SpecularReflectance, m_PhongExponent };
+		}
+
 	private:
 		ColorRGB m_DiffuseColor{ colors::White };
 		float m_DiffuseReflectance{ 0.5f }; //kd
@@ -108,38 +127,16 @@ namespace dae
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const override
 		{
 			//todo: W3
 			//throw std::runtime_error("Not Implemented Yet");
-			ColorRGB f0{};
-			if (m_Metalness < 1)
-			{
-				f0 = ColorRGB{ 0.04f,0.04f,0.04f };
-			}
-			else
-			{
-				f0 = m_Albedo;
-			}
-			
-			Vector3 h{ ((l + v) / (v + l).Magnitude()).Normalized()};
-
-			ColorRGB F{ BRDF::FresnelFunction_Schlick(h,v,f0) };
-			ColorRGB D{ ColorRGB{1,1,1}*BRDF::NormalDistribution_GGX(hitRecord.normal,h,m_Roughness) };
-			ColorRGB G{ ColorRGB{1,1,1}*BRDF::GeometryFunction_Smith(hitRecord.normal,v,l,m_Roughness) };
-			ColorRGB specular{ (D * F * G) / (4 * (Vector3::Dot(v,hitRecord.normal) * Vector3::Dot(l,hitRecord.normal))) };
-
-			ColorRGB diffuse{};
-			ColorRGB kd{};
-			if (m_Metalness == 0)
-			{
-				kd= ColorRGB{1,1,1} - F;
-				diffuse = BRDF::Lambert(kd, m_Albedo);
-			}
-			//diffuse = BRDF::Lambert(kd, m_Albedo);
-
-			return specular+diffuse;
-			//return {};
+			return BRDF::CookTorrence(m_Albedo, m_Metalness, m_Roughness, hitRecord.normal, l, v);
+		}
+
+		MaterialData GetData() const override
+		{
+			return { MaterialType::CookTorrence, m_Albedo, 0.f, 0.f, 0.f, m_Metalness, m_Roughness };
 		}
 
 	private:
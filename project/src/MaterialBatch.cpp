@@ -0,0 +1,170 @@
+#include "MaterialBatch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "BRDFs.h"
+
+namespace dae
+{
+	//The per hit math works on plain floats and the scalar BRDF terms, without branches
+	//The batch loops run it over the SoA arrays, ShadeMaterial on one hit, so both give the same bits
+	//Everything that only depends on the material is computed once, outside the loops
+
+	static ColorRGB GetLambert(const MaterialData& material)
+	{
+		return BRDF::Lambert(material.diffuseReflectance, material.color);
+	}
+
+	//Phong is a grey lobe, only one channel is needed
+	static inline float ShadePhong(float specularReflectance, float phongExponent,
+		float nx, float ny, float nz, float lx, float ly, float lz, float vx, float vy, float vz)
+	{
+		//Reflect(l, n) against -v
+		const float twoCosTheta{ 2.f * (lx * nx + ly * ny + lz * nz) };
+		const float rx{ lx - nx * twoCosTheta };
+		const float ry{ ly - ny * twoCosTheta };
+		const float rz{ lz - nz * twoCosTheta };
+		return BRDF::PhongSpecular(specularReflectance, phongExponent, rx * -vx + ry * -vy + rz * -vz);
+	}
+
+	struct CookTorrenceConstants
+	{
+		ColorRGB albedo;
+		//Dielectrics reflect 4% head on, metals their albedo
+		ColorRGB f0;
+		ColorRGB oneMinusF0;
+		float alphaSquared;
+		float k;
+		//Only pure dielectrics get a diffuse lobe
+		bool hasDiffuse;
+	};
+
+	static CookTorrenceConstants GetCookTorrenceConstants(const MaterialData& material)
+	{
+		const ColorRGB f0{ material.metalness < 1 ? ColorRGB{ .04f, .04f, .04f } : material.color };
+		const float alpha{ Square(material.roughness) };
+		return { material.color, f0, ColorRGB{ 1, 1, 1 } - f0, Square(alpha), Square(alpha + 1) / 8, material.metalness == 0 };
+	}
+
+	static inline void ShadeCookTorrence(const CookTorrenceConstants& constants,
+		float nx, float ny, float nz, float lx, float ly, float lz, float vx, float vy, float vz, float& red, float& green, float& blue)
+	{
+		//Half vector, normalized twice like the vector version
+		const float sumX{ lx + vx }, sumY{ ly + vy }, sumZ{ lz + vz };
+		const float sumLength{ std::sqrt(sumX * sumX + sumY * sumY + sumZ * sumZ) };
+		const float scaledX{ sumX / sumLength }, scaledY{ sumY / sumLength }, scaledZ{ sumZ / sumLength };
+		const float scaledLength{ std::sqrt(scaledX * scaledX + scaledY * scaledY + scaledZ * scaledZ) };
+		const float hx{ scaledX / scaledLength }, hy{ scaledY / scaledLength }, hz{ scaledZ / scaledLength };
+
+		const float fresnel{ BRDF::FresnelWeight_Schlick(hx * vx + hy * vy + hz * vz) };
+		const float fr{ constants.f0.r + constants.oneMinusF0.r * fresnel };
+		const float fg{ constants.f0.g + constants.oneMinusF0.g * fresnel };
+		const float fb{ constants.f0.b + constants.oneMinusF0.b * fresnel };
+
+		const float cosNormalView{ nx * vx + ny * vy + nz * vz };
+		const float cosNormalLight{ nx * lx + ny * ly + nz * lz };
+		const float D{ BRDF::NormalDistribution_GGX(nx * hx + ny * hy + nz * hz, constants.alphaSquared) };
+		const float G{ BRDF::GeometryFunction_SchlickGGX(cosNormalView, constants.k) * BRDF::GeometryFunction_SchlickGGX(cosNormalLight, constants.k) };
+		const float denominator{ 4 * (cosNormalView * cosNormalLight) };
+		const float specularR{ D * fr * G / denominator };
+		const float specularG{ D * fg * G / denominator };
+		const float specularB{ D * fb * G / denominator };
+
+		//Lambert with kd = 1 - F, selected instead of branched on
+		const float diffuseR{ (1 - fr) * constants.albedo.r / PI };
+		const float diffuseG{ (1 - fg) * constants.albedo.g / PI };
+		const float diffuseB{ (1 - fb) * constants.albedo.b / PI };
+		red = constants.hasDiffuse ? specularR + diffuseR : specularR;
+		green = constants.hasDiffuse ? specularG + diffuseG : specularG;
+		blue = constants.hasDiffuse ? specularB + diffuseB : specularB;
+	}
+
+	ColorRGB ShadeMaterial(const MaterialData& material, const Vector3& normal, const Vector3& l, const Vector3& v)
+	{
+		switch (material.type)
+		{
+		case MaterialType::Lambert:
+			return GetLambert(material);
+		case MaterialType::LambertPhong:
+		{
+			const float phong{ ShadePhong(material.specularReflectance, material.phongExponent, normal.x, normal.y, normal.z, l.x, l.y, l.z, v.x, v.y, v.z) };
+			const ColorRGB lambert{ GetLambert(material) };
+			return { lambert.r + phong, lambert.g + phong, lambert.b + phong };
+		}
+		case MaterialType::CookTorrence:
+		{
+			ColorRGB color{};
+			ShadeCookTorrence(GetCookTorrenceConstants(material), normal.x, normal.y, normal.z, l.x, l.y, l.z, v.x, v.y, v.z, color.r, color.g, color.b);
+			return color;
+		}
+		default:
+			return material.color;
+		}
+	}
+
+	void ShadeBatch_SolidColor(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue)
+	{
+		std::fill_n(pRed, batch.size, material.color.r);
+		std::fill_n(pGreen, batch.size, material.color.g);
+		std::fill_n(pBlue, batch.size, material.color.b);
+	}
+
+	void ShadeBatch_Lambert(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue)
+	{
+		//Does not depend on the directions at all
+		const ColorRGB lambert{ GetLambert(material) };
+		std::fill_n(pRed, batch.size, lambert.r);
+		std::fill_n(pGreen, batch.size, lambert.g);
+		std::fill_n(pBlue, batch.size, lambert.b);
+	}
+
+	void ShadeBatch_LambertPhong(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue)
+	{
+		const ColorRGB lambert{ GetLambert(material) };
+		const float specularReflectance{ material.specularReflectance };
+		const float phongExponent{ material.phongExponent };
+		for (int i{}; i < batch.size; ++i)
+		{
+			const float phong{ ShadePhong(specularReflectance, phongExponent,
+				batch.normalX[i], batch.normalY[i], batch.normalZ[i],
+				batch.lightX[i], batch.lightY[i], batch.lightZ[i],
+				batch.viewX[i], batch.viewY[i], batch.viewZ[i]) };
+			pRed[i] = lambert.r + phong;
+			pGreen[i] = lambert.g + phong;
+			pBlue[i] = lambert.b + phong;
+		}
+	}
+
+	void ShadeBatch_CookTorrence(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue)
+	{
+		const CookTorrenceConstants constants{ GetCookTorrenceConstants(material) };
+		for (int i{}; i < batch.size; ++i)
+		{
+			ShadeCookTorrence(constants,
+				batch.normalX[i], batch.normalY[i], batch.normalZ[i],
+				batch.lightX[i], batch.lightY[i], batch.lightZ[i],
+				batch.viewX[i], batch.viewY[i], batch.viewZ[i],
+				pRed[i], pGreen[i], pBlue[i]);
+		}
+	}
+
+	void ShadeBatch(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue)
+	{
+		switch (material.type)
+		{
+		case MaterialType::Lambert:
+			ShadeBatch_Lambert(material, batch, pRed, pGreen, pBlue);
+			break;
+		case MaterialType::LambertPhong:
+			ShadeBatch_LambertPhong(material, batch, pRed, pGreen, pBlue);
+			break;
+		case MaterialType::CookTorrence:
+			ShadeBatch_CookTorrence(material, batch, pRed, pGreen, pBlue);
+			break;
+		default:
+			ShadeBatch_SolidColor(material, batch, pRed, pGreen, pBlue);
+			break;
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+
+#include "ColorRGB.h"
+#include "Vector3.h"
+
+namespace dae
+{
+	//Closed set of shading models, the renderer switches on this instead of calling through the vtable
+	enum class MaterialType : uint8_t
+	{
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
+	};
+
+	//Plain copy of the parameters of one material, the fields a type does not use stay 0
+	struct MaterialData
+	{
+		MaterialType type{ MaterialType::SolidColor };
+		//Solid color, diffuse color or albedo
+		ColorRGB color{};
+		float diffuseReflectance{};
+		float specularReflectance{};
+		float phongExponent{};
+		float metalness{};
+		float roughness{};
+	};
+
+	//Hits shaded with one material and one light, one array per component so the loops run over plain floats
+	struct ShadingBatch
+	{
+		static constexpr int MaxSize{ 64 };
+
+		alignas(32) float normalX[MaxSize];
+		alignas(32) float normalY[MaxSize];
+		alignas(32) float normalZ[MaxSize];
+		//Normalized, towards the light
+		alignas(32) float lightX[MaxSize];
+		alignas(32) float lightY[MaxSize];
+		alignas(32) float lightZ[MaxSize];
+		//Normalized, towards the camera
+		alignas(32) float viewX[MaxSize];
+		alignas(32) float viewY[MaxSize];
+		alignas(32) float viewZ[MaxSize];
+		int size{};
+	};
+
+	//Same result as Material::Shade of the material the data was taken from
+	ColorRGB ShadeMaterial(const MaterialData& material, const Vector3& normal, const Vector3& l, const Vector3& v);
+
+	//Writes the BRDF of every hit in the batch, no branches inside the loops except on the material type
+	void ShadeBatch_SolidColor(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue);
+	void ShadeBatch_Lambert(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue);
+	void ShadeBatch_LambertPhong(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue);
+	void ShadeBatch_CookTorrence(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue);
+
+	//Dispatches on material.type
+	void ShadeBatch(const MaterialData& material, const ShadingBatch& batch, float* pRed, float* pGreen, float* pBlue);
+}
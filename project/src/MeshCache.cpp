@@ -0,0 +1,243 @@
+#include "MeshCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "MappedFile.h"
+#include "OBJLoader.h"
+
+namespace dae
+{
+	//Bump whenever the header, a section or the layout of a stored type changes
+	static constexpr uint32_t MeshCacheVersion{ 1 };
+	static constexpr char MeshCacheMagic[8]{ 'D', 'A', 'E', 'M', 'E', 'S', 'H', '\0' };
+	//Every section starts on a cache line, so the mapped data could be used as it is
+	static constexpr size_t SectionAlignment{ 64 };
+
+	enum MeshCacheSection
+	{
+		Positions,
+		Normals,
+		Indices,
+		VertexNormals,
+		UVs,
+		Nodes,
+		PrimitiveIndices,
+		NrSections
+	};
+
+	static constexpr uint32_t SectionElementSizes[NrSections]{
+		sizeof(Vector3), sizeof(Vector3), sizeof(int), sizeof(Vector3), sizeof(TextureCoordinate), sizeof(BVHNode), sizeof(uint32_t) };
+
+	struct MeshCacheHeader
+	{
+		char magic[8]{};
+		uint32_t version{};
+		uint32_t buildMode{};
+		//Size and write time of the OBJ the cache was made from
+		uint64_t sourceSize{};
+		int64_t sourceTime{};
+		uint32_t elementSizes[NrSections]{};
+		uint64_t counts[NrSections]{};
+	};
+
+	static size_t AlignSection(size_t offset)
+	{
+		return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+	}
+
+	static bool GetSourceStamp(const std::string& filename, uint64_t& size, int64_t& time)
+	{
+		std::error_code error{};
+		size = std::filesystem::file_size(filename, error);
+		if (error)
+			return false;
+		time = static_cast<int64_t>(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+		return !error;
+	}
+
+	template<typename T>
+	static void ReadSection(const char* pData, size_t offset, uint64_t count, std::vector<T>& elements)
+	{
+		elements.resize(count);
+		if (count > 0)
+			std::memcpy(elements.data(), pData + offset, count * sizeof(T));
+	}
+
+	//The sections only get the sizes checked by the header, so the indices into each other are checked here
+	//A cache that got corrupted or was written by a broken build is rejected instead of traced out of bounds
+	static bool IsValidMeshCache(const std::vector<Vector3>& positions, const std::vector<Vector3>& normals, const std::vector<int>& indices,
+		const std::vector<Vector3>& vertexNormals, const std::vector<TextureCoordinate>& uvs,
+		const std::vector<BVHNode>& nodes, const std::vector<uint32_t>& primitiveIndices)
+	{
+		const size_t nrTriangles{ indices.size() / 3 };
+		if (indices.size() % 3 != 0 || normals.size() != nrTriangles || primitiveIndices.size() != nrTriangles
+			|| (!vertexNormals.empty() && vertexNormals.size() != positions.size()) || (!uvs.empty() && uvs.size() != positions.size())
+			|| nodes.empty() != (nrTriangles == 0))
+			return false;
+
+		for (const int index : indices)
+		{
+			if (index < 0 || size_t(index) >= positions.size())
+				return false;
+		}
+
+		for (const uint32_t primitiveIndex : primitiveIndices)
+		{
+			if (primitiveIndex >= nrTriangles)
+				return false;
+		}
+
+		for (size_t i{}; i < nodes.size(); ++i)
+		{
+			const BVHNode& node{ nodes[i] };
+			//Children always come after their parent, which also rules out cycles
+			if (node.IsLeaf() ? uint64_t(node.leftFirst) + node.primitiveCount > primitiveIndices.size()
+				: node.leftFirst <= i || uint64_t(node.leftFirst) + 1 >= nodes.size())
+				return false;
+		}
+		return true;
+	}
+
+	static bool ReadMeshCache(const std::string& cacheFilename, const MeshCacheHeader& expected, TriangleMesh& mesh)
+	{
+		MappedFile file{};
+		if (!file.Open(cacheFilename) || file.GetSize() < sizeof(MeshCacheHeader))
+			return false;
+
+		MeshCacheHeader header{};
+		std::memcpy(&header, file.GetData(), sizeof(MeshCacheHeader));
+		if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version || header.buildMode != expected.buildMode
+			|| header.sourceSize != expected.sourceSize || header.sourceTime != expected.sourceTime
+			|| std::memcmp(header.elementSizes, expected.elementSizes, sizeof(header.elementSizes)) != 0)
+			return false;
+
+		size_t offsets[NrSections]{};
+		size_t offset{ AlignSection(sizeof(MeshCacheHeader)) };
+		for (int section{}; section < NrSections; ++section)
+		{
+			//A count this large can only come from a damaged header, and would overflow the offsets
+			if (header.counts[section] > file.GetSize())
+				return false;
+			offsets[section] = offset;
+			offset = AlignSection(offset + header.counts[section] * header.elementSizes[section]);
+		}
+		if (offset != file.GetSize())
+			return false;
+
+		//Read next to the mesh, so a rejected cache leaves it empty for the parse
+		const char* pData{ file.GetData() };
+		std::vector<Vector3> positions{};
+		std::vector<Vector3> normals{};
+		std::vector<int> indices{};
+		std::vector<Vector3> vertexNormals{};
+		std::vector<TextureCoordinate> uvs{};
+		std::vector<BVHNode> nodes{};
+		std::vector<uint32_t> primitiveIndices{};
+		ReadSection(pData, offsets[Positions], header.counts[Positions], positions);
+		ReadSection(pData, offsets[Normals], header.counts[Normals], normals);
+		ReadSection(pData, offsets[Indices], header.counts[Indices], indices);
+		ReadSection(pData, offsets[VertexNormals], header.counts[VertexNormals], vertexNormals);
+		ReadSection(pData, offsets[UVs], header.counts[UVs], uvs);
+		ReadSection(pData, offsets[Nodes], header.counts[Nodes], nodes);
+		ReadSection(pData, offsets[PrimitiveIndices], header.counts[PrimitiveIndices], primitiveIndices);
+		if (!IsValidMeshCache(positions, normals, indices, vertexNormals, uvs, nodes, primitiveIndices))
+			return false;
+
+		mesh.positions = std::move(positions);
+		mesh.normals = std::move(normals);
+		mesh.indices = std::move(indices);
+		mesh.vertexNormals = std::move(vertexNormals);
+		mesh.uvs = std::move(uvs);
+		mesh.bvh.Assign(std::move(nodes), std::move(primitiveIndices));
+		return true;
+	}
+
+	//The header and every section are padded up to the next section start
+	static void WritePadded(std::ofstream& stream, const void* pData, size_t size)
+	{
+		static constexpr char padding[SectionAlignment]{};
+		stream.write(static_cast<const char*>(pData), size);
+		stream.write(padding, AlignSection(size) - size);
+	}
+
+	template<typename T>
+	static void WriteSection(std::ofstream& stream, const std::vector<T>& elements)
+	{
+		WritePadded(stream, elements.data(), elements.size() * sizeof(T));
+	}
+
+	//Written to a temporary file first, so a crash or a second instance never leaves half a cache behind
+	static bool WriteMeshCache(const std::string& cacheFilename, MeshCacheHeader header, const TriangleMesh& mesh)
+	{
+		const BVH& bvh{ mesh.bvh };
+		header.counts[Positions] = mesh.positions.size();
+		header.counts[Normals] = mesh.normals.size();
+		header.counts[Indices] = mesh.indices.size();
+		header.counts[VertexNormals] = mesh.vertexNormals.size();
+		header.counts[UVs] = mesh.uvs.size();
+		header.counts[Nodes] = bvh.GetNodes().size();
+		header.counts[PrimitiveIndices] = bvh.GetPrimitiveIndices().size();
+
+		const std::string temporaryFilename{ cacheFilename + ".tmp" };
+		{
+			std::ofstream stream{ temporaryFilename, std::ios::binary | std::ios::trunc };
+			if (!stream)
+				return false;
+
+			WritePadded(stream, &header, sizeof(MeshCacheHeader));
+			WriteSection(stream, mesh.positions);
+			WriteSection(stream, mesh.normals);
+			WriteSection(stream, mesh.indices);
+			WriteSection(stream, mesh.vertexNormals);
+			WriteSection(stream, mesh.uvs);
+			WriteSection(stream, bvh.GetNodes());
+			WriteSection(stream, bvh.GetPrimitiveIndices());
+			if (!stream)
+				return false;
+		}
+
+		std::error_code error{};
+		std::filesystem::rename(temporaryFilename, cacheFilename, error);
+		if (error)
+			std::filesystem::remove(temporaryFilename, error);
+		return !error;
+	}
+
+	bool LoadCachedOBJ(const std::string& filename, TriangleMesh& mesh)
+	{
+		//The cache replaces the whole mesh and only holds an object space BVH
+		const bool canUseCache{ mesh.positions.empty() && mesh.indices.empty() && mesh.transformMode == TriangleMeshTransformMode::ObjectSpace };
+
+		//Zeroed as a whole, the padding between the fields is written to the file as well
+		MeshCacheHeader header{};
+		std::memset(static_cast<void*>(&header), 0, sizeof(MeshCacheHeader));
+		std::memcpy(header.magic, MeshCacheMagic, sizeof(header.magic));
+		header.version = MeshCacheVersion;
+		header.buildMode = static_cast<uint32_t>(mesh.bvh.GetBuildMode());
+		std::memcpy(header.elementSizes, SectionElementSizes, sizeof(header.elementSizes));
+		const bool hasSourceStamp{ GetSourceStamp(filename, header.sourceSize, header.sourceTime) };
+
+		const std::string cacheFilename{ GetMeshCacheFilename(filename) };
+		if (canUseCache && hasSourceStamp && ReadMeshCache(cacheFilename, header, mesh))
+		{
+			mesh.UpdateFromBVH();
+			return true;
+		}
+
+		if (!LoadOBJ(filename, mesh))
+			return false;
+		mesh.RebuildBVH();
+
+		//A read only resource folder only costs the next start the parse again
+		if (canUseCache && hasSourceStamp)
+			WriteMeshCache(cacheFilename, header, mesh);
+		return true;
+	}
+
+	std::string GetMeshCacheFilename(const std::string& filename)
+	{
+		return filename + ".cache";
+	}
+}
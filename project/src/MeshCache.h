@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Loads an OBJ into an empty ObjectSpace mesh through a binary cache written next to it (<filename>.cache)
+	//The cache holds the vertices, indices, normals, vertex attributes and the object space BVH in the layout of the vectors,
+	//so a valid cache is mapped and copied over without parsing the text or building the BVH
+	//A missing cache, or one from another version, build mode or state of the OBJ, is rebuilt from the text and rewritten
+	//Other meshes just get LoadOBJ, the BVH is built on return either way
+	bool LoadCachedOBJ(const std::string& filename, TriangleMesh& mesh);
+
+	std::string GetMeshCacheFilename(const std::string& filename);
+}
@@ -0,0 +1,218 @@
+#include "MeshKernels.h"
+
+#include <algorithm>
+
+#include "DataTypes.h"
+#include "ParallelFor.h"
+
+namespace dae
+{
+	//Fewer elements than this are not worth a task
+	static constexpr uint32_t MinRangeSize{ 8192 };
+
+	//The SSE kernels read and write blocks of 4 vertices as 12 floats
+	static_assert(sizeof(Vector3) == 3 * sizeof(float));
+
+	static void TransformPoints_Scalar(const Matrix& transform, const Vector3* pPoints, Vector3* pTransformed, size_t count)
+	{
+		for (size_t i{}; i < count; ++i)
+			pTransformed[i] = transform.TransformPoint(pPoints[i]);
+	}
+
+	static void TransformVectors_Scalar(const Matrix& transform, const Vector3* pVectors, Vector3* pTransformed, size_t count)
+	{
+		for (size_t i{}; i < count; ++i)
+			pTransformed[i] = transform.TransformVector(pVectors[i]);
+	}
+
+	static void CalculateTriangleNormals_Scalar(const Vector3* pPositions, const int* pIndices, size_t nrTriangles, Vector3* pNormals)
+	{
+		for (size_t i{}; i < nrTriangles; ++i)
+		{
+			const int* pTriangle{ pIndices + i * 3 };
+			const Vector3 e1{ pPositions[pTriangle[1]] - pPositions[pTriangle[0]] };
+			const Vector3 e2{ pPositions[pTriangle[2]] - pPositions[pTriangle[0]] };
+			pNormals[i] = Vector3::Cross(e1, e2).Normalized();
+		}
+	}
+
+#if defined(DAE_X86)
+	//[x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] to [x0 x1 x2 x3] [y0 y1 y2 y3] [z0 z1 z2 z3]
+	DAE_TARGET("sse4.1")
+	static void LoadVector3x4(const Vector3* pVectors, __m128& x, __m128& y, __m128& z)
+	{
+		const float* pFloats{ &pVectors->x };
+		const __m128 a{ _mm_loadu_ps(pFloats) };
+		const __m128 b{ _mm_loadu_ps(pFloats + 4) };
+		const __m128 c{ _mm_loadu_ps(pFloats + 8) };
+
+		x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+		y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	//Inverse of LoadVector3x4
+	DAE_TARGET("sse4.1")
+	static void StoreVector3x4(Vector3* pVectors, __m128 x, __m128 y, __m128 z)
+	{
+		float* pFloats{ &pVectors->x };
+		_mm_storeu_ps(pFloats, _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(pFloats + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(pFloats + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+	}
+
+	//Same operation order as Matrix::TransformPoint/TransformVector, so every lane rounds like the scalar code
+	template<bool IsPoint>
+	DAE_TARGET("sse4.1")
+	static void TransformVector3s_SSE41(const Matrix& transform, const Vector3* pInput, Vector3* pTransformed, size_t count)
+	{
+		__m128 m[4][3]{};
+		for (int row{}; row < 4; ++row)
+		{
+			const Vector4 rowData{ transform[row] };
+			m[row][0] = _mm_set1_ps(rowData.x);
+			m[row][1] = _mm_set1_ps(rowData.y);
+			m[row][2] = _mm_set1_ps(rowData.z);
+		}
+
+		size_t i{};
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x, y, z;
+			LoadVector3x4(pInput + i, x, y, z);
+
+			__m128 result[3];
+			for (int column{}; column < 3; ++column)
+			{
+				result[column] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][column], x), _mm_mul_ps(m[1][column], y)), _mm_mul_ps(m[2][column], z));
+				if constexpr (IsPoint)
+					result[column] = _mm_add_ps(result[column], m[3][column]);
+			}
+			StoreVector3x4(pTransformed + i, result[0], result[1], result[2]);
+		}
+
+		if constexpr (IsPoint)
+			TransformPoints_Scalar(transform, pInput + i, pTransformed + i, count - i);
+		else
+			TransformVectors_Scalar(transform, pInput + i, pTransformed + i, count - i);
+	}
+
+	//Corner of 4 consecutive triangles, one triangle per lane
+	DAE_TARGET("sse4.1")
+	static void GatherCorner(const Vector3* pPositions, const int* pIndices, int corner, __m128& x, __m128& y, __m128& z)
+	{
+		const Vector3& p0{ pPositions[pIndices[corner]] };
+		const Vector3& p1{ pPositions[pIndices[3 + corner]] };
+		const Vector3& p2{ pPositions[pIndices[6 + corner]] };
+		const Vector3& p3{ pPositions[pIndices[9 + corner]] };
+		x = _mm_setr_ps(p0.x, p1.x, p2.x, p3.x);
+		y = _mm_setr_ps(p0.y, p1.y, p2.y, p3.y);
+		z = _mm_setr_ps(p0.z, p1.z, p2.z, p3.z);
+	}
+
+	//Cross and Normalized with the scalar operation order, sqrt and div are exact in SSE too
+	DAE_TARGET("sse4.1")
+	static void CalculateTriangleNormals_SSE41(const Vector3* pPositions, const int* pIndices, size_t nrTriangles, Vector3* pNormals)
+	{
+		size_t i{};
+		for (; i + 4 <= nrTriangles; i += 4)
+		{
+			const int* pTriangles{ pIndices + i * 3 };
+			__m128 x0, y0, z0, x1, y1, z1, x2, y2, z2;
+			GatherCorner(pPositions, pTriangles, 0, x0, y0, z0);
+			GatherCorner(pPositions, pTriangles, 1, x1, y1, z1);
+			GatherCorner(pPositions, pTriangles, 2, x2, y2, z2);
+
+			const __m128 e1x{ _mm_sub_ps(x1, x0) }, e1y{ _mm_sub_ps(y1, y0) }, e1z{ _mm_sub_ps(z1, z0) };
+			const __m128 e2x{ _mm_sub_ps(x2, x0) }, e2y{ _mm_sub_ps(y2, y0) }, e2z{ _mm_sub_ps(z2, z0) };
+
+			const __m128 nx{ _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y)) };
+			const __m128 ny{ _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z)) };
+			const __m128 nz{ _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x)) };
+			const __m128 magnitude{ _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz))) };
+
+			StoreVector3x4(pNormals + i, _mm_div_ps(nx, magnitude), _mm_div_ps(ny, magnitude), _mm_div_ps(nz, magnitude));
+		}
+		CalculateTriangleNormals_Scalar(pPositions, pIndices + i * 3, nrTriangles - i, pNormals + i);
+	}
+#endif
+
+	void CalculateTriangleNormals(const Vector3* pPositions, const int* pIndices, size_t nrTriangles, Vector3* pNormals, [[maybe_unused]] SimdLevel simdLevel)
+	{
+#if defined(DAE_X86)
+		if (std::min(simdLevel, GetSupportedSimdLevel()) >= SimdLevel::SSE41)
+		{
+			CalculateTriangleNormals_SSE41(pPositions, pIndices, nrTriangles, pNormals);
+			return;
+		}
+#endif
+		CalculateTriangleNormals_Scalar(pPositions, pIndices, nrTriangles, pNormals);
+	}
+
+	void CalculateTriangleNormals(const std::vector<Vector3>& positions, const std::vector<int>& indices, std::vector<Vector3>& normals)
+	{
+		const uint32_t nrTriangles{ static_cast<uint32_t>(indices.size() / 3) };
+		normals.resize(nrTriangles);
+		const SimdLevel simdLevel{ GetSupportedSimdLevel() };
+		ParallelForRanges(nrTriangles, MinRangeSize, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				CalculateTriangleNormals(positions.data(), indices.data() + size_t(begin) * 3, end - begin, normals.data() + begin, simdLevel);
+			});
+	}
+
+	template<bool IsPoint>
+	static void TransformVector3s(const Matrix& transform, const std::vector<Vector3>& input, std::vector<Vector3>& transformed, SimdLevel simdLevel)
+	{
+		transformed.resize(input.size());
+		[[maybe_unused]] const bool useSSE41{ std::min(simdLevel, GetSupportedSimdLevel()) >= SimdLevel::SSE41 };
+		ParallelForRanges(static_cast<uint32_t>(input.size()), MinRangeSize, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				const Vector3* pInput{ input.data() + begin };
+				Vector3* pTransformed{ transformed.data() + begin };
+#if defined(DAE_X86)
+				if (useSSE41)
+				{
+					TransformVector3s_SSE41<IsPoint>(transform, pInput, pTransformed, end - begin);
+					return;
+				}
+#endif
+				if constexpr (IsPoint)
+					TransformPoints_Scalar(transform, pInput, pTransformed, end - begin);
+				else
+					TransformVectors_Scalar(transform, pInput, pTransformed, end - begin);
+			});
+	}
+
+	void TransformPoints(const Matrix& transform, const std::vector<Vector3>& points, std::vector<Vector3>& transformedPoints)
+	{
+		TransformVector3s<true>(transform, points, transformedPoints, GetSupportedSimdLevel());
+	}
+
+	void TransformVectors(const Matrix& transform, const std::vector<Vector3>& vectors, std::vector<Vector3>& transformedVectors)
+	{
+		TransformVector3s<false>(transform, vectors, transformedVectors, GetSupportedSimdLevel());
+	}
+
+	void TransformPoints(const Matrix& transform, const std::vector<Vector3>& points, std::vector<Vector3>& transformedPoints, SimdLevel simdLevel)
+	{
+		TransformVector3s<true>(transform, points, transformedPoints, simdLevel);
+	}
+
+	void TransformVectors(const Matrix& transform, const std::vector<Vector3>& vectors, std::vector<Vector3>& transformedVectors, SimdLevel simdLevel)
+	{
+		TransformVector3s<false>(transform, vectors, transformedVectors, simdLevel);
+	}
+
+	void BuildTriangleRecords(const std::vector<Vector3>& positions, const std::vector<Vector3>& normals, const std::vector<int>& indices, std::vector<TriangleRecord>& triangles)
+	{
+		triangles.resize(indices.size() / 3);
+		ParallelForRanges(static_cast<uint32_t>(triangles.size()), MinRangeSize, [&](uint32_t, uint32_t begin, uint32_t end)
+			{
+				for (size_t i{ begin }; i < end; ++i)
+				{
+					const Vector3& v0{ positions[indices[i * 3]] };
+					triangles[i] = { v0, positions[indices[i * 3 + 1]] - v0, positions[indices[i * 3 + 2]] - v0, normals[i] };
+				}
+			});
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+
+#include "Maths.h"
+#include "Simd.h"
+
+namespace dae
+{
+	struct TriangleRecord;
+
+	//Per vertex and per triangle passes of TriangleMesh, MeshGeometry and the OBJ loader
+	//Big meshes are split over threads, each range runs 4 elements at a time with SSE4.1:
+	//blocks of 4 Vector3 are transposed into x, y and z registers and back, so no separate SoA copy can go stale
+	//Results match the scalar Vector3/Matrix math bit for bit
+	//Outputs are resized, never cleared, so the per frame calls keep reusing the same memory
+
+	//One normal per triangle, in the order of the index buffer
+	void CalculateTriangleNormals(const std::vector<Vector3>& positions, const std::vector<int>& indices, std::vector<Vector3>& normals);
+	//Serial version for callers that already run in parallel, writes nrTriangles normals starting at the triangle pIndices points to
+	void CalculateTriangleNormals(const Vector3* pPositions, const int* pIndices, size_t nrTriangles, Vector3* pNormals, SimdLevel simdLevel);
+
+	void TransformPoints(const Matrix& transform, const std::vector<Vector3>& points, std::vector<Vector3>& transformedPoints);
+	void TransformVectors(const Matrix& transform, const std::vector<Vector3>& vectors, std::vector<Vector3>& transformedVectors);
+	//Falls back to the best supported level when the requested one is not available on this CPU
+	void TransformPoints(const Matrix& transform, const std::vector<Vector3>& points, std::vector<Vector3>& transformedPoints, SimdLevel simdLevel);
+	void TransformVectors(const Matrix& transform, const std::vector<Vector3>& vectors, std::vector<Vector3>& transformedVectors, SimdLevel simdLevel);
+
+	void BuildTriangleRecords(const std::vector<Vector3>& positions, const std::vector<Vector3>& normals, const std::vector<int>& indices, std::vector<TriangleRecord>& triangles);
+}
@@ -0,0 +1,437 @@
+#include "OBJLoader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+#include "MappedFile.h"
+#include "MeshKernels.h"
+#include "TileScheduler.h"
+
+namespace dae
+{
+	//Smaller chunks are not worth handing to another thread
+	static constexpr size_t MinChunkSize{ 1 << 20 };
+	//More chunks than threads, so a thread that gets a chunk full of comments steals work from the others
+	static constexpr int ChunksPerThread{ 4 };
+
+	//One corner of a triangle as written in the file
+	//Positive indices are already 0-based file indices, negative ones were made relative to the start of their chunk
+	//because the chunk does not know how many elements came before it, the flags tell them apart
+	struct OBJCorner
+	{
+		enum Flags : uint8_t
+		{
+			HasUV = 1 << 0,
+			HasNormal = 1 << 1,
+			RelativePosition = 1 << 2,
+			RelativeUV = 1 << 3,
+			RelativeNormal = 1 << 4
+		};
+
+		int position{};
+		int uv{};
+		int normal{};
+		uint8_t flags{};
+	};
+
+	//What one line aligned piece of the file holds, faces are already fanned into triangles
+	struct OBJChunk
+	{
+		const char* pBegin{ nullptr };
+		const char* pEnd{ nullptr };
+		std::vector<Vector3> positions{};
+		std::vector<TextureCoordinate> uvs{};
+		std::vector<Vector3> vertexNormals{};
+		std::vector<OBJCorner> corners{};
+		bool hasAttributes{ false };
+		bool isValid{ true };
+
+		//Where this chunk's elements start in the file
+		size_t filePosition{};
+		size_t fileUV{};
+		size_t fileNormal{};
+		//Where this chunk's corners go in the merged index buffer
+		size_t firstIndex{};
+	};
+
+	//\r is treated as a blank so files with Windows line endings parse the same
+	static bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static const char* SkipBlanks(const char* p, const char* pEnd)
+	{
+		while (p != pEnd && IsBlank(*p))
+			++p;
+		return p;
+	}
+
+	template<typename T>
+	static bool ParseNumber(const char*& p, const char* pLineEnd, T& value)
+	{
+		p = SkipBlanks(p, pLineEnd);
+		//from_chars does not accept a leading plus
+		if (p != pLineEnd && *p == '+')
+			++p;
+		const std::from_chars_result result{ std::from_chars(p, pLineEnd, value) };
+		if (result.ec != std::errc{})
+			return false;
+		p = result.ptr;
+		return true;
+	}
+
+	//Turns a file index into a 0-based one, nrSeen is how many elements of that kind the chunk has read so far
+	static bool ResolveIndex(int fileIndex, size_t nrSeen, int& index, bool& isRelative)
+	{
+		isRelative = fileIndex < 0;
+		index = isRelative ? static_cast<int>(nrSeen) + fileIndex : fileIndex - 1;
+		return fileIndex != 0;
+	}
+
+	//Reads one face vertex: p, p/t, p//n or p/t/n
+	static bool ParseCorner(const char*& p, const char* pLineEnd, const OBJChunk& chunk, OBJCorner& corner)
+	{
+		int fileIndex{};
+		bool isRelative{};
+		if (!ParseNumber(p, pLineEnd, fileIndex) || !ResolveIndex(fileIndex, chunk.positions.size(), corner.position, isRelative))
+			return false;
+		if (isRelative)
+			corner.flags |= OBJCorner::RelativePosition;
+
+		if (p != pLineEnd && *p == '/')
+		{
+			++p;
+			if (p != pLineEnd && *p != '/')
+			{
+				if (!ParseNumber(p, pLineEnd, fileIndex) || !ResolveIndex(fileIndex, chunk.uvs.size(), corner.uv, isRelative))
+					return false;
+				corner.flags |= isRelative ? OBJCorner::HasUV | OBJCorner::RelativeUV : OBJCorner::HasUV;
+			}
+			if (p != pLineEnd && *p == '/')
+			{
+				++p;
+				if (!ParseNumber(p, pLineEnd, fileIndex) || !ResolveIndex(fileIndex, chunk.vertexNormals.size(), corner.normal, isRelative))
+					return false;
+				corner.flags |= isRelative ? OBJCorner::HasNormal | OBJCorner::RelativeNormal : OBJCorner::HasNormal;
+			}
+		}
+		return p == pLineEnd || IsBlank(*p);
+	}
+
+	//Fans the polygon around its first corner, so a face of n corners gives n - 2 triangles
+	static bool ParseFace(const char* p, const char* pLineEnd, OBJChunk& chunk)
+	{
+		OBJCorner first{}, previous{};
+		int nrCorners{};
+		for (p = SkipBlanks(p, pLineEnd); p != pLineEnd && *p != '#'; p = SkipBlanks(p, pLineEnd))
+		{
+			OBJCorner corner{};
+			if (!ParseCorner(p, pLineEnd, chunk, corner))
+				return false;
+			chunk.hasAttributes |= (corner.flags & (OBJCorner::HasUV | OBJCorner::HasNormal)) != 0;
+
+			if (nrCorners == 0)
+				first = corner;
+			else if (nrCorners >= 2)
+				chunk.corners.insert(chunk.corners.end(), { first, previous, corner });
+			previous = corner;
+			++nrCorners;
+		}
+		return nrCorners >= 3;
+	}
+
+	static void ParseChunk(OBJChunk& chunk)
+	{
+		const char* p{ chunk.pBegin };
+		while (p < chunk.pEnd)
+		{
+			const char* pLineEnd{ static_cast<const char*>(std::memchr(p, '\n', chunk.pEnd - p)) };
+			if (!pLineEnd)
+				pLineEnd = chunk.pEnd;
+
+			p = SkipBlanks(p, pLineEnd);
+			const char* pCommandEnd{ p };
+			while (pCommandEnd != pLineEnd && !IsBlank(*pCommandEnd))
+				++pCommandEnd;
+			const std::string_view command{ p, static_cast<size_t>(pCommandEnd - p) };
+
+			//Groups, objects, materials and smoothing groups are skipped, like comments
+			if (command == "v")
+			{
+				Vector3 position{};
+				chunk.isValid &= ParseNumber(pCommandEnd, pLineEnd, position.x) && ParseNumber(pCommandEnd, pLineEnd, position.y) && ParseNumber(pCommandEnd, pLineEnd, position.z);
+				chunk.positions.push_back(position);
+			}
+			else if (command == "vt")
+			{
+				//An optional w is ignored
+				TextureCoordinate uv{};
+				chunk.isValid &= ParseNumber(pCommandEnd, pLineEnd, uv.u);
+				if (SkipBlanks(pCommandEnd, pLineEnd) != pLineEnd)
+					chunk.isValid &= ParseNumber(pCommandEnd, pLineEnd, uv.v);
+				chunk.uvs.push_back(uv);
+			}
+			else if (command == "vn")
+			{
+				Vector3 normal{};
+				chunk.isValid &= ParseNumber(pCommandEnd, pLineEnd, normal.x) && ParseNumber(pCommandEnd, pLineEnd, normal.y) && ParseNumber(pCommandEnd, pLineEnd, normal.z);
+				chunk.vertexNormals.push_back(normal);
+			}
+			else if (command == "f")
+			{
+				chunk.isValid &= ParseFace(pCommandEnd, pLineEnd, chunk);
+			}
+			p = pLineEnd + 1;
+		}
+	}
+
+	//Cuts the text at the first line break after every 1/nrChunks of it
+	static std::vector<OBJChunk> SplitIntoChunks(const char* pText, size_t size, size_t nrChunks)
+	{
+		std::vector<OBJChunk> chunks(nrChunks);
+		const char* pEnd{ pText + size };
+		const char* pBegin{ pText };
+		for (size_t i{}; i < nrChunks; ++i)
+		{
+			const char* pChunkEnd{ pEnd };
+			if (i + 1 < nrChunks)
+			{
+				const char* pTarget{ std::max(pText + size * (i + 1) / nrChunks, pBegin) };
+				const char* pLineBreak{ static_cast<const char*>(std::memchr(pTarget, '\n', pEnd - pTarget)) };
+				pChunkEnd = pLineBreak ? pLineBreak + 1 : pEnd;
+			}
+			chunks[i].pBegin = pBegin;
+			chunks[i].pEnd = pChunkEnd;
+			pBegin = pChunkEnd;
+		}
+		return chunks;
+	}
+
+	//File index of one element of a corner, -1 when the corner does not have it or it is out of range
+	static int GetFileIndex(int index, bool isRelative, size_t chunkStart, size_t nrInFile)
+	{
+		const int64_t fileIndex{ isRelative ? static_cast<int64_t>(chunkStart) + index : index };
+		return fileIndex >= 0 && fileIndex < static_cast<int64_t>(nrInFile) ? static_cast<int>(fileIndex) : -1;
+	}
+
+	//A vertex is the combination of position, uv and normal a corner uses, -1 marks a missing uv or normal
+	struct OBJVertexKey
+	{
+		int position{};
+		int uv{};
+		int normal{};
+
+		bool operator==(const OBJVertexKey& other) const
+		{
+			return position == other.position && uv == other.uv && normal == other.normal;
+		}
+	};
+
+	struct OBJVertexKeyHash
+	{
+		size_t operator()(const OBJVertexKey& key) const
+		{
+			uint64_t hash{ static_cast<uint32_t>(key.position) * 0x9E3779B97F4A7C15ull };
+			hash ^= (static_cast<uint32_t>(key.uv) + 0x632BE59BD9B4E019ull + (hash << 6) + (hash >> 2));
+			hash ^= (static_cast<uint32_t>(key.normal) + 0x8CB92BA72F3D8DD7ull + (hash << 6) + (hash >> 2));
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	struct OBJOutput
+	{
+		std::vector<Vector3>& positions;
+		std::vector<Vector3>& normals;
+		std::vector<int>& indices;
+		//Only set when the caller keeps per vertex attributes
+		std::vector<Vector3>* pVertexNormals{ nullptr };
+		std::vector<TextureCoordinate>* pUVs{ nullptr };
+	};
+
+	//Gives every distinct position/uv/normal combination its own vertex
+	//The first combination that uses a position keeps the slot of that position, so files without vt and vn keep their vertex order
+	//Runs on one thread since which combination comes first depends on the whole file
+	static bool DeduplicateVertices(std::vector<OBJChunk>& chunks, size_t nrFilePositions, const std::vector<TextureCoordinate>& fileUVs, const std::vector<Vector3>& fileNormals, size_t firstPosition, const OBJOutput& output)
+	{
+		std::vector<Vector3>& positions{ output.positions };
+		std::vector<Vector3>& vertexNormals{ *output.pVertexNormals };
+		std::vector<TextureCoordinate>& uvs{ *output.pUVs };
+		vertexNormals.resize(positions.size());
+		uvs.resize(positions.size());
+
+		//uv and normal the slot of every file position was claimed with, position -1 while unclaimed
+		std::vector<OBJVertexKey> slotKeys(nrFilePositions, OBJVertexKey{ -1, -1, -1 });
+		std::unordered_map<OBJVertexKey, int, OBJVertexKeyHash> extraVertices{};
+
+		for (const OBJChunk& chunk : chunks)
+		{
+			for (size_t i{}; i < chunk.corners.size(); ++i)
+			{
+				const OBJCorner& corner{ chunk.corners[i] };
+				const OBJVertexKey key{
+					GetFileIndex(corner.position, corner.flags & OBJCorner::RelativePosition, chunk.filePosition, nrFilePositions),
+					corner.flags & OBJCorner::HasUV ? GetFileIndex(corner.uv, corner.flags & OBJCorner::RelativeUV, chunk.fileUV, fileUVs.size()) : -1,
+					corner.flags & OBJCorner::HasNormal ? GetFileIndex(corner.normal, corner.flags & OBJCorner::RelativeNormal, chunk.fileNormal, fileNormals.size()) : -1 };
+				if (key.position < 0 || ((corner.flags & OBJCorner::HasUV) && key.uv < 0) || ((corner.flags & OBJCorner::HasNormal) && key.normal < 0))
+					return false;
+
+				int vertex{ static_cast<int>(firstPosition) + key.position };
+				OBJVertexKey& slotKey{ slotKeys[key.position] };
+				if (slotKey.position < 0)
+				{
+					slotKey = key;
+					if (key.uv >= 0)
+						uvs[vertex] = fileUVs[key.uv];
+					if (key.normal >= 0)
+						vertexNormals[vertex] = fileNormals[key.normal];
+				}
+				else if (!(slotKey == key))
+				{
+					const auto [it, isNew] { extraVertices.try_emplace(key, static_cast<int>(positions.size())) };
+					vertex = it->second;
+					if (isNew)
+					{
+						positions.push_back(positions[firstPosition + key.position]);
+						uvs.push_back(key.uv >= 0 ? fileUVs[key.uv] : TextureCoordinate{});
+						vertexNormals.push_back(key.normal >= 0 ? fileNormals[key.normal] : Vector3{});
+					}
+				}
+				output.indices[chunk.firstIndex + i] = vertex;
+			}
+		}
+		return true;
+	}
+
+	static bool ParseOBJ(const char* pText, size_t size, const OBJOutput& output, int nrThreads)
+	{
+		TileScheduler scheduler{};
+		size_t nrChunks{ 1 };
+		if (size > 2 * MinChunkSize)
+		{
+			scheduler.Start(nrThreads);
+			nrChunks = std::clamp(size / MinChunkSize, size_t{ 1 }, static_cast<size_t>(scheduler.GetThreadCount()) * ChunksPerThread);
+		}
+
+		std::vector<OBJChunk> chunks{ SplitIntoChunks(pText, size, nrChunks) };
+		auto parseChunk{ [&](uint32_t chunkIndex)
+			{
+				ParseChunk(chunks[chunkIndex]);
+			} };
+		scheduler.Run(static_cast<uint32_t>(nrChunks), parseChunk);
+
+		std::vector<Vector3>& positions{ output.positions };
+		std::vector<int>& indices{ output.indices };
+
+		//Face indices count from the first vertex of the file, so they only move by what was in the vectors already
+		const size_t firstPosition{ positions.size() };
+		const size_t firstIndex{ indices.size() };
+		size_t nrPositions{}, nrUVs{}, nrVertexNormals{}, nrIndices{};
+		bool hasAttributes{ false };
+		for (OBJChunk& chunk : chunks)
+		{
+			if (!chunk.isValid)
+				return false;
+			chunk.filePosition = nrPositions;
+			chunk.fileUV = nrUVs;
+			chunk.fileNormal = nrVertexNormals;
+			chunk.firstIndex = firstIndex + nrIndices;
+			nrPositions += chunk.positions.size();
+			nrUVs += chunk.uvs.size();
+			nrVertexNormals += chunk.vertexNormals.size();
+			nrIndices += chunk.corners.size();
+			hasAttributes |= chunk.hasAttributes;
+		}
+		//Attributes are only split into vertices when the caller keeps them
+		const bool keepAttributes{ output.pVertexNormals && output.pUVs && (hasAttributes || !output.pVertexNormals->empty() || !output.pUVs->empty()) };
+
+		positions.resize(firstPosition + nrPositions);
+		indices.resize(firstIndex + nrIndices);
+		std::vector<TextureCoordinate> fileUVs(keepAttributes ? nrUVs : 0);
+		std::vector<Vector3> fileNormals(keepAttributes ? nrVertexNormals : 0);
+
+		auto mergeElements{ [&](uint32_t chunkIndex)
+			{
+				const OBJChunk& chunk{ chunks[chunkIndex] };
+				std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + firstPosition + chunk.filePosition);
+				if (keepAttributes)
+				{
+					std::copy(chunk.uvs.begin(), chunk.uvs.end(), fileUVs.begin() + chunk.fileUV);
+					std::copy(chunk.vertexNormals.begin(), chunk.vertexNormals.end(), fileNormals.begin() + chunk.fileNormal);
+				}
+			} };
+		scheduler.Run(static_cast<uint32_t>(nrChunks), mergeElements);
+
+		//Faces can use vertices of any chunk, so this waits until all positions are in place
+		if (keepAttributes)
+		{
+			if (!DeduplicateVertices(chunks, nrPositions, fileUVs, fileNormals, firstPosition, output))
+				return false;
+		}
+		else
+		{
+			auto mergeIndices{ [&](uint32_t chunkIndex)
+				{
+					OBJChunk& chunk{ chunks[chunkIndex] };
+					for (size_t i{}; i < chunk.corners.size(); ++i)
+					{
+						const OBJCorner& corner{ chunk.corners[i] };
+						const int index{ GetFileIndex(corner.position, corner.flags & OBJCorner::RelativePosition, chunk.filePosition, nrPositions) };
+						chunk.isValid &= index >= 0;
+						//Unused uvs and normals still have to exist
+						if (corner.flags & OBJCorner::HasUV)
+							chunk.isValid &= GetFileIndex(corner.uv, corner.flags & OBJCorner::RelativeUV, chunk.fileUV, nrUVs) >= 0;
+						if (corner.flags & OBJCorner::HasNormal)
+							chunk.isValid &= GetFileIndex(corner.normal, corner.flags & OBJCorner::RelativeNormal, chunk.fileNormal, nrVertexNormals) >= 0;
+						indices[chunk.firstIndex + i] = static_cast<int>(firstPosition) + index;
+					}
+				} };
+			scheduler.Run(static_cast<uint32_t>(nrChunks), mergeIndices);
+			if (!std::all_of(chunks.begin(), chunks.end(), [](const OBJChunk& chunk) { return chunk.isValid; }))
+				return false;
+		}
+
+		//Precompute normals
+		std::vector<Vector3>& normals{ output.normals };
+		normals.resize(normals.size() + nrIndices / 3);
+		Vector3* pNormals{ normals.data() + normals.size() - nrIndices / 3 };
+		const SimdLevel simdLevel{ GetSupportedSimdLevel() };
+		auto calculateNormals{ [&](uint32_t chunkIndex)
+			{
+				const OBJChunk& chunk{ chunks[chunkIndex] };
+				CalculateTriangleNormals(positions.data(), indices.data() + chunk.firstIndex, chunk.corners.size() / 3, pNormals + (chunk.firstIndex - firstIndex) / 3, simdLevel);
+			} };
+		scheduler.Run(static_cast<uint32_t>(nrChunks), calculateNormals);
+
+		return true;
+	}
+
+	bool LoadOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, int nrThreads)
+	{
+		MappedFile file{};
+		if (!file.Open(filename))
+			return false;
+		return ParseOBJText(file.GetData(), file.GetSize(), positions, normals, indices, nrThreads);
+	}
+
+	bool LoadOBJ(const std::string& filename, TriangleMesh& mesh, int nrThreads)
+	{
+		MappedFile file{};
+		if (!file.Open(filename))
+			return false;
+		return ParseOBJText(file.GetData(), file.GetSize(), mesh, nrThreads);
+	}
+
+	bool ParseOBJText(const char* pText, size_t size, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, int nrThreads)
+	{
+		return ParseOBJ(pText, size, OBJOutput{ positions, normals, indices }, nrThreads);
+	}
+
+	bool ParseOBJText(const char* pText, size_t size, TriangleMesh& mesh, int nrThreads)
+	{
+		return ParseOBJ(pText, size, OBJOutput{ mesh.positions, mesh.normals, mesh.indices, &mesh.vertexNormals, &mesh.uvs }, nrThreads);
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	//Parses the v, vt, vn and f lines of an OBJ file and adds one normal per triangle
+	//Faces take any number of p, p/t, p//n or p/t/n corners, negative indices count back from the last element read, polygons are fanned into triangles
+	//The file is memory mapped and cut into line aligned chunks that are parsed in parallel, then merged in file order
+	//Appends to the vectors like Utils::ParseOBJ does, nrThreads 0 uses every hardware thread
+	bool LoadOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, int nrThreads = 0);
+	//Also fills the per vertex normals and uvs of the mesh, a position used with different uvs or normals is split into one vertex per combination
+	//Nothing is transformed or rebuilt, call UpdateTransforms after loading like after filling the vectors by hand
+	bool LoadOBJ(const std::string& filename, TriangleMesh& mesh, int nrThreads = 0);
+	//Same as LoadOBJ on text that is already in memory
+	bool ParseOBJText(const char* pText, size_t size, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, int nrThreads = 0);
+	bool ParseOBJText(const char* pText, size_t size, TriangleMesh& mesh, int nrThreads = 0);
+}
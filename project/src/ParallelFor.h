@@ -0,0 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//How many ranges ParallelForRanges splits count into, for callers that keep per range results
+	inline uint32_t GetNrParallelRanges(uint32_t count, uint32_t minRangeSize)
+	{
+		const uint32_t nrThreads{ std::max(1u, std::thread::hardware_concurrency()) };
+		return std::clamp(count / std::max(1u, minRangeSize), 1u, nrThreads * 4);
+	}
+
+	//Splits [0, count) into contiguous ranges and runs them on the parallel execution policy
+	//The split only depends on count and minRangeSize, so two calls with the same arguments hand out the same ranges
+	//A single range runs on the calling thread
+	template<typename Function>
+	void ParallelForRanges(uint32_t count, uint32_t minRangeSize, Function&& function)
+	{
+		const uint32_t nrRanges{ GetNrParallelRanges(count, minRangeSize) };
+		if (nrRanges == 1)
+		{
+			function(0u, 0u, count);
+			return;
+		}
+
+		std::vector<uint32_t> rangeIndices(nrRanges);
+		std::iota(rangeIndices.begin(), rangeIndices.end(), 0);
+
+		std::for_each(std::execution::par, rangeIndices.begin(), rangeIndices.end(), [&](uint32_t rangeIndex)
+			{
+				const uint32_t begin{ static_cast<uint32_t>(uint64_t(count) * rangeIndex / nrRanges) };
+				const uint32_t end{ static_cast<uint32_t>(uint64_t(count) * (rangeIndex + 1) / nrRanges) };
+				function(rangeIndex, begin, end);
+			});
+	}
+}
@@ -0,0 +1,433 @@
+#include "PrimitiveSoA.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace dae
+{
+	static size_t GetPaddedSize(uint32_t count, int width)
+	{
+		return (count + width - 1) / width * width;
+	}
+
+#pragma region Build
+	void SphereSoA::Build(const std::vector<Sphere>& spheres)
+	{
+		Build(spheres, GetSupportedSimdLevel());
+	}
+
+	void SphereSoA::Build(const std::vector<Sphere>& spheres, SimdLevel level)
+	{
+		simdLevel = std::min(level, GetSupportedSimdLevel());
+		count = static_cast<uint32_t>(spheres.size());
+
+		//NaN makes every comparison in the hit test fail, padded lanes never win
+		const size_t paddedSize{ GetPaddedSize(count, Width) };
+		const float nan{ std::numeric_limits<float>::quiet_NaN() };
+		originX.assign(paddedSize, nan);
+		originY.assign(paddedSize, nan);
+		originZ.assign(paddedSize, nan);
+		radiusSquared.assign(paddedSize, nan);
+
+		for (uint32_t i{}; i < count; ++i)
+		{
+			const Sphere& sphere{ spheres[i] };
+			originX[i] = sphere.origin.x;
+			originY[i] = sphere.origin.y;
+			originZ[i] = sphere.origin.z;
+			radiusSquared[i] = Square(sphere.radius);
+		}
+	}
+
+	void SphereSoA::Clear()
+	{
+		originX.clear();
+		originY.clear();
+		originZ.clear();
+		radiusSquared.clear();
+		count = 0;
+	}
+
+	void PlaneSoA::Build(const std::vector<Plane>& planes)
+	{
+		Build(planes, GetSupportedSimdLevel());
+	}
+
+	void PlaneSoA::Build(const std::vector<Plane>& planes, SimdLevel level)
+	{
+		simdLevel = std::min(level, GetSupportedSimdLevel());
+		count = static_cast<uint32_t>(planes.size());
+
+		const size_t paddedSize{ GetPaddedSize(count, Width) };
+		const float nan{ std::numeric_limits<float>::quiet_NaN() };
+		originX.assign(paddedSize, 0.f);
+		originY.assign(paddedSize, 0.f);
+		originZ.assign(paddedSize, 0.f);
+		normalX.assign(paddedSize, nan);
+		normalY.assign(paddedSize, nan);
+		normalZ.assign(paddedSize, nan);
+
+		for (uint32_t i{}; i < count; ++i)
+		{
+			const Plane& plane{ planes[i] };
+			originX[i] = plane.origin.x;
+			originY[i] = plane.origin.y;
+			originZ[i] = plane.origin.z;
+			normalX[i] = plane.normal.x;
+			normalY[i] = plane.normal.y;
+			normalZ[i] = plane.normal.z;
+		}
+	}
+
+	void PlaneSoA::Clear()
+	{
+		originX.clear();
+		originY.clear();
+		originZ.clear();
+		normalX.clear();
+		normalY.clear();
+		normalZ.clear();
+		count = 0;
+	}
+#pragma endregion
+
+#pragma region Scalar
+	int IntersectSpheres_Scalar(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit)
+	{
+		//Same operation order as HitTest_Sphere
+		const float A{ Vector3::Dot(ray.direction, ray.direction) };
+		const Vector3 twoDirection{ 2 * ray.direction };
+
+		int closestIndex{ -1 };
+		float closestT{ ray.max };
+		for (uint32_t i{}; i < spheres.count; ++i)
+		{
+			const Vector3 sphereToOrigin{ ray.origin.x - spheres.originX[i], ray.origin.y - spheres.originY[i], ray.origin.z - spheres.originZ[i] };
+			const float B{ Vector3::Dot(twoDirection, sphereToOrigin) };
+			const float C{ Vector3::Dot(sphereToOrigin, sphereToOrigin) - spheres.radiusSquared[i] };
+			const float D{ Square(B) - (4 * A * C) };
+			if (D <= 0)
+				continue;
+
+			float tSphere{ (-B - sqrtf(D)) / (2 * A) };
+			if (tSphere < ray.min)
+				tSphere = (-B + sqrtf(D)) / (2 * A);
+
+			if (tSphere > ray.min && tSphere < closestT)
+			{
+				closestT = tSphere;
+				closestIndex = static_cast<int>(i);
+				if (anyHit)
+					break;
+			}
+		}
+
+		if (closestIndex >= 0)
+			t = closestT;
+		return closestIndex;
+	}
+
+	int IntersectPlanes_Scalar(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit)
+	{
+		int closestIndex{ -1 };
+		float closestT{ ray.max };
+		for (uint32_t i{}; i < planes.count; ++i)
+		{
+			const Vector3 normal{ planes.normalX[i], planes.normalY[i], planes.normalZ[i] };
+			const Vector3 originToPlane{ planes.originX[i] - ray.origin.x, planes.originY[i] - ray.origin.y, planes.originZ[i] - ray.origin.z };
+			const float tPlane{ Vector3::Dot(originToPlane, normal) / Vector3::Dot(ray.direction, normal) };
+
+			if (tPlane > ray.min && tPlane < closestT)
+			{
+				closestT = tPlane;
+				closestIndex = static_cast<int>(i);
+				if (anyHit)
+					break;
+			}
+		}
+
+		if (closestIndex >= 0)
+			t = closestT;
+		return closestIndex;
+	}
+#pragma endregion
+
+#if defined(DAE_X86)
+	//Picks the closest lane, on equal distances the lowest primitive index wins like in a front-to-back loop
+	static int ReduceClosest(const float* laneT, const int* laneIndex, int width, float& t)
+	{
+		int closestIndex{ -1 };
+		for (int lane{}; lane < width; ++lane)
+		{
+			if (laneIndex[lane] < 0)
+				continue;
+
+			if (closestIndex < 0 || laneT[lane] < t || (laneT[lane] == t && laneIndex[lane] < closestIndex))
+			{
+				t = laneT[lane];
+				closestIndex = laneIndex[lane];
+			}
+		}
+		return closestIndex;
+	}
+
+#pragma region SSE4.1
+	DAE_TARGET("sse4.1")
+	int IntersectSpheres_SSE41(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit)
+	{
+		const float A{ Vector3::Dot(ray.direction, ray.direction) };
+		const __m128 fourA{ _mm_set1_ps(4 * A) };
+		const __m128 twoA{ _mm_set1_ps(2 * A) };
+		const __m128 twoDirectionX{ _mm_set1_ps(2 * ray.direction.x) };
+		const __m128 twoDirectionY{ _mm_set1_ps(2 * ray.direction.y) };
+		const __m128 twoDirectionZ{ _mm_set1_ps(2 * ray.direction.z) };
+		const __m128 originX{ _mm_set1_ps(ray.origin.x) };
+		const __m128 originY{ _mm_set1_ps(ray.origin.y) };
+		const __m128 originZ{ _mm_set1_ps(ray.origin.z) };
+		const __m128 rayMin{ _mm_set1_ps(ray.min) };
+		const __m128 zero{ _mm_setzero_ps() };
+		const __m128 signBit{ _mm_set1_ps(-0.f) };
+
+		__m128 closestT{ _mm_set1_ps(ray.max) };
+		__m128i closestIndex{ _mm_set1_epi32(-1) };
+		__m128i indices{ _mm_setr_epi32(0, 1, 2, 3) };
+		const __m128i step{ _mm_set1_epi32(4) };
+
+		const size_t size{ spheres.originX.size() };
+		for (size_t i{}; i < size; i += 4, indices = _mm_add_epi32(indices, step))
+		{
+			const __m128 toOriginX{ _mm_sub_ps(originX, _mm_loadu_ps(&spheres.originX[i])) };
+			const __m128 toOriginY{ _mm_sub_ps(originY, _mm_loadu_ps(&spheres.originY[i])) };
+			const __m128 toOriginZ{ _mm_sub_ps(originZ, _mm_loadu_ps(&spheres.originZ[i])) };
+
+			const __m128 B{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(twoDirectionX, toOriginX), _mm_mul_ps(twoDirectionY, toOriginY)), _mm_mul_ps(twoDirectionZ, toOriginZ)) };
+			const __m128 lengthSquared{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(toOriginX, toOriginX), _mm_mul_ps(toOriginY, toOriginY)), _mm_mul_ps(toOriginZ, toOriginZ)) };
+			const __m128 C{ _mm_sub_ps(lengthSquared, _mm_loadu_ps(&spheres.radiusSquared[i])) };
+			const __m128 D{ _mm_sub_ps(_mm_mul_ps(B, B), _mm_mul_ps(fourA, C)) };
+
+			const __m128 sqrtD{ _mm_sqrt_ps(D) };
+			const __m128 minusB{ _mm_xor_ps(B, signBit) };
+			const __m128 tNear{ _mm_div_ps(_mm_sub_ps(minusB, sqrtD), twoA) };
+			const __m128 tFar{ _mm_div_ps(_mm_add_ps(minusB, sqrtD), twoA) };
+			//Origin inside the sphere: the near root is behind the ray, use the far one
+			const __m128 tSphere{ _mm_blendv_ps(tNear, tFar, _mm_cmplt_ps(tNear, rayMin)) };
+
+			const __m128 hitMask{ _mm_and_ps(_mm_cmpgt_ps(D, zero), _mm_and_ps(_mm_cmpgt_ps(tSphere, rayMin), _mm_cmplt_ps(tSphere, closestT))) };
+			closestT = _mm_blendv_ps(closestT, tSphere, hitMask);
+			closestIndex = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(closestIndex), _mm_castsi128_ps(indices), hitMask));
+
+			if (anyHit && _mm_movemask_ps(hitMask) != 0)
+				break;
+		}
+
+		alignas(16) float laneT[4];
+		alignas(16) int laneIndex[4];
+		_mm_store_ps(laneT, closestT);
+		_mm_store_si128(reinterpret_cast<__m128i*>(laneIndex), closestIndex);
+		return ReduceClosest(laneT, laneIndex, 4, t);
+	}
+
+	DAE_TARGET("sse4.1")
+	int IntersectPlanes_SSE41(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit)
+	{
+		const __m128 directionX{ _mm_set1_ps(ray.direction.x) };
+		const __m128 directionY{ _mm_set1_ps(ray.direction.y) };
+		const __m128 directionZ{ _mm_set1_ps(ray.direction.z) };
+		const __m128 originX{ _mm_set1_ps(ray.origin.x) };
+		const __m128 originY{ _mm_set1_ps(ray.origin.y) };
+		const __m128 originZ{ _mm_set1_ps(ray.origin.z) };
+		const __m128 rayMin{ _mm_set1_ps(ray.min) };
+
+		__m128 closestT{ _mm_set1_ps(ray.max) };
+		__m128i closestIndex{ _mm_set1_epi32(-1) };
+		__m128i indices{ _mm_setr_epi32(0, 1, 2, 3) };
+		const __m128i step{ _mm_set1_epi32(4) };
+
+		const size_t size{ planes.originX.size() };
+		for (size_t i{}; i < size; i += 4, indices = _mm_add_epi32(indices, step))
+		{
+			const __m128 normalX{ _mm_loadu_ps(&planes.normalX[i]) };
+			const __m128 normalY{ _mm_loadu_ps(&planes.normalY[i]) };
+			const __m128 normalZ{ _mm_loadu_ps(&planes.normalZ[i]) };
+			const __m128 toPlaneX{ _mm_sub_ps(_mm_loadu_ps(&planes.originX[i]), originX) };
+			const __m128 toPlaneY{ _mm_sub_ps(_mm_loadu_ps(&planes.originY[i]), originY) };
+			const __m128 toPlaneZ{ _mm_sub_ps(_mm_loadu_ps(&planes.originZ[i]), originZ) };
+
+			const __m128 numerator{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(toPlaneX, normalX), _mm_mul_ps(toPlaneY, normalY)), _mm_mul_ps(toPlaneZ, normalZ)) };
+			const __m128 denominator{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, normalX), _mm_mul_ps(directionY, normalY)), _mm_mul_ps(directionZ, normalZ)) };
+			const __m128 tPlane{ _mm_div_ps(numerator, denominator) };
+
+			const __m128 hitMask{ _mm_and_ps(_mm_cmpgt_ps(tPlane, rayMin), _mm_cmplt_ps(tPlane, closestT)) };
+			closestT = _mm_blendv_ps(closestT, tPlane, hitMask);
+			closestIndex = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(closestIndex), _mm_castsi128_ps(indices), hitMask));
+
+			if (anyHit && _mm_movemask_ps(hitMask) != 0)
+				break;
+		}
+
+		alignas(16) float laneT[4];
+		alignas(16) int laneIndex[4];
+		_mm_store_ps(laneT, closestT);
+		_mm_store_si128(reinterpret_cast<__m128i*>(laneIndex), closestIndex);
+		return ReduceClosest(laneT, laneIndex, 4, t);
+	}
+#pragma endregion
+
+#pragma region AVX2
+	DAE_TARGET("avx2")
+	int IntersectSpheres_AVX2(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit)
+	{
+		const float A{ Vector3::Dot(ray.direction, ray.direction) };
+		const __m256 fourA{ _mm256_set1_ps(4 * A) };
+		const __m256 twoA{ _mm256_set1_ps(2 * A) };
+		const __m256 twoDirectionX{ _mm256_set1_ps(2 * ray.direction.x) };
+		const __m256 twoDirectionY{ _mm256_set1_ps(2 * ray.direction.y) };
+		const __m256 twoDirectionZ{ _mm256_set1_ps(2 * ray.direction.z) };
+		const __m256 originX{ _mm256_set1_ps(ray.origin.x) };
+		const __m256 originY{ _mm256_set1_ps(ray.origin.y) };
+		const __m256 originZ{ _mm256_set1_ps(ray.origin.z) };
+		const __m256 rayMin{ _mm256_set1_ps(ray.min) };
+		const __m256 zero{ _mm256_setzero_ps() };
+		const __m256 signBit{ _mm256_set1_ps(-0.f) };
+
+		__m256 closestT{ _mm256_set1_ps(ray.max) };
+		__m256i closestIndex{ _mm256_set1_epi32(-1) };
+		__m256i indices{ _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) };
+		const __m256i step{ _mm256_set1_epi32(8) };
+
+		//No FMA, the products are rounded separately like in the scalar test
+		const size_t size{ spheres.originX.size() };
+		for (size_t i{}; i < size; i += 8, indices = _mm256_add_epi32(indices, step))
+		{
+			const __m256 toOriginX{ _mm256_sub_ps(originX, _mm256_loadu_ps(&spheres.originX[i])) };
+			const __m256 toOriginY{ _mm256_sub_ps(originY, _mm256_loadu_ps(&spheres.originY[i])) };
+			const __m256 toOriginZ{ _mm256_sub_ps(originZ, _mm256_loadu_ps(&spheres.originZ[i])) };
+
+			const __m256 B{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(twoDirectionX, toOriginX), _mm256_mul_ps(twoDirectionY, toOriginY)), _mm256_mul_ps(twoDirectionZ, toOriginZ)) };
+			const __m256 lengthSquared{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toOriginX, toOriginX), _mm256_mul_ps(toOriginY, toOriginY)), _mm256_mul_ps(toOriginZ, toOriginZ)) };
+			const __m256 C{ _mm256_sub_ps(lengthSquared, _mm256_loadu_ps(&spheres.radiusSquared[i])) };
+			const __m256 D{ _mm256_sub_ps(_mm256_mul_ps(B, B), _mm256_mul_ps(fourA, C)) };
+
+			const __m256 sqrtD{ _mm256_sqrt_ps(D) };
+			const __m256 minusB{ _mm256_xor_ps(B, signBit) };
+			const __m256 tNear{ _mm256_div_ps(_mm256_sub_ps(minusB, sqrtD), twoA) };
+			const __m256 tFar{ _mm256_div_ps(_mm256_add_ps(minusB, sqrtD), twoA) };
+			const __m256 tSphere{ _mm256_blendv_ps(tNear, tFar, _mm256_cmp_ps(tNear, rayMin, _CMP_LT_OQ)) };
+
+			const __m256 hitMask{ _mm256_and_ps(_mm256_cmp_ps(D, zero, _CMP_GT_OQ),
+				_mm256_and_ps(_mm256_cmp_ps(tSphere, rayMin, _CMP_GT_OQ), _mm256_cmp_ps(tSphere, closestT, _CMP_LT_OQ))) };
+			closestT = _mm256_blendv_ps(closestT, tSphere, hitMask);
+			closestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(closestIndex), _mm256_castsi256_ps(indices), hitMask));
+
+			if (anyHit && _mm256_movemask_ps(hitMask) != 0)
+				break;
+		}
+
+		alignas(32) float laneT[8];
+		alignas(32) int laneIndex[8];
+		_mm256_store_ps(laneT, closestT);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(laneIndex), closestIndex);
+		return ReduceClosest(laneT, laneIndex, 8, t);
+	}
+
+	DAE_TARGET("avx2")
+	int IntersectPlanes_AVX2(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit)
+	{
+		const __m256 directionX{ _mm256_set1_ps(ray.direction.x) };
+		const __m256 directionY{ _mm256_set1_ps(ray.direction.y) };
+		const __m256 directionZ{ _mm256_set1_ps(ray.direction.z) };
+		const __m256 originX{ _mm256_set1_ps(ray.origin.x) };
+		const __m256 originY{ _mm256_set1_ps(ray.origin.y) };
+		const __m256 originZ{ _mm256_set1_ps(ray.origin.z) };
+		const __m256 rayMin{ _mm256_set1_ps(ray.min) };
+
+		__m256 closestT{ _mm256_set1_ps(ray.max) };
+		__m256i closestIndex{ _mm256_set1_epi32(-1) };
+		__m256i indices{ _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) };
+		const __m256i step{ _mm256_set1_epi32(8) };
+
+		const size_t size{ planes.originX.size() };
+		for (size_t i{}; i < size; i += 8, indices = _mm256_add_epi32(indices, step))
+		{
+			const __m256 normalX{ _mm256_loadu_ps(&planes.normalX[i]) };
+			const __m256 normalY{ _mm256_loadu_ps(&planes.normalY[i]) };
+			const __m256 normalZ{ _mm256_loadu_ps(&planes.normalZ[i]) };
+			const __m256 toPlaneX{ _mm256_sub_ps(_mm256_loadu_ps(&planes.originX[i]), originX) };
+			const __m256 toPlaneY{ _mm256_sub_ps(_mm256_loadu_ps(&planes.originY[i]), originY) };
+			const __m256 toPlaneZ{ _mm256_sub_ps(_mm256_loadu_ps(&planes.originZ[i]), originZ) };
+
+			const __m256 numerator{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(toPlaneX, normalX), _mm256_mul_ps(toPlaneY, normalY)), _mm256_mul_ps(toPlaneZ, normalZ)) };
+			const __m256 denominator{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, normalX), _mm256_mul_ps(directionY, normalY)), _mm256_mul_ps(directionZ, normalZ)) };
+			const __m256 tPlane{ _mm256_div_ps(numerator, denominator) };
+
+			const __m256 hitMask{ _mm256_and_ps(_mm256_cmp_ps(tPlane, rayMin, _CMP_GT_OQ), _mm256_cmp_ps(tPlane, closestT, _CMP_LT_OQ)) };
+			closestT = _mm256_blendv_ps(closestT, tPlane, hitMask);
+			closestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(closestIndex), _mm256_castsi256_ps(indices), hitMask));
+
+			if (anyHit && _mm256_movemask_ps(hitMask) != 0)
+				break;
+		}
+
+		alignas(32) float laneT[8];
+		alignas(32) int laneIndex[8];
+		_mm256_store_ps(laneT, closestT);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(laneIndex), closestIndex);
+		return ReduceClosest(laneT, laneIndex, 8, t);
+	}
+#pragma endregion
+#else
+	//Never selected on other architectures, GetSupportedSimdLevel always reports Scalar there
+	int IntersectSpheres_SSE41(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit)
+	{
+		return IntersectSpheres_Scalar(spheres, ray, t, anyHit);
+	}
+
+	int IntersectSpheres_AVX2(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit)
+	{
+		return IntersectSpheres_Scalar(spheres, ray, t, anyHit);
+	}
+
+	int IntersectPlanes_SSE41(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit)
+	{
+		return IntersectPlanes_Scalar(planes, ray, t, anyHit);
+	}
+
+	int IntersectPlanes_AVX2(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit)
+	{
+		return IntersectPlanes_Scalar(planes, ray, t, anyHit);
+	}
+#endif
+
+	int IntersectSpheres(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit)
+	{
+		if (spheres.count == 0)
+			return -1;
+
+		switch (spheres.simdLevel)
+		{
+		case SimdLevel::AVX2:
+			return IntersectSpheres_AVX2(spheres, ray, t, anyHit);
+		case SimdLevel::SSE41:
+			return IntersectSpheres_SSE41(spheres, ray, t, anyHit);
+		default:
+			return IntersectSpheres_Scalar(spheres, ray, t, anyHit);
+		}
+	}
+
+	int IntersectPlanes(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit)
+	{
+		if (planes.count == 0)
+			return -1;
+
+		switch (planes.simdLevel)
+		{
+		case SimdLevel::AVX2:
+			return IntersectPlanes_AVX2(planes, ray, t, anyHit);
+		case SimdLevel::SSE41:
+			return IntersectPlanes_SSE41(planes, ray, t, anyHit);
+		default:
+			return IntersectPlanes_Scalar(planes, ray, t, anyHit);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+#include "Simd.h"
+
+namespace dae
+{
+	//Structure-of-arrays mirror of the scene spheres, one SIMD load reads the same component of 8 spheres
+	//The arrays are padded to a multiple of Width with NaN centers that never pass the hit test
+	struct SphereSoA
+	{
+		static constexpr int Width{ 8 };
+
+		std::vector<float> originX{};
+		std::vector<float> originY{};
+		std::vector<float> originZ{};
+		std::vector<float> radiusSquared{};
+		uint32_t count{};
+		SimdLevel simdLevel{ SimdLevel::Scalar };
+
+		void Build(const std::vector<Sphere>& spheres);
+		//Falls back to the best supported level when the requested one is not available on this CPU
+		void Build(const std::vector<Sphere>& spheres, SimdLevel level);
+		void Clear();
+	};
+
+	//Structure-of-arrays mirror of the scene planes, padded with NaN normals
+	struct PlaneSoA
+	{
+		static constexpr int Width{ 8 };
+
+		std::vector<float> originX{};
+		std::vector<float> originY{};
+		std::vector<float> originZ{};
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		uint32_t count{};
+		SimdLevel simdLevel{ SimdLevel::Scalar };
+
+		void Build(const std::vector<Plane>& planes);
+		void Build(const std::vector<Plane>& planes, SimdLevel level);
+		void Clear();
+	};
+
+	//Returns the index of the closest primitive with a hit inside (ray.min, ray.max) and writes its distance to t, -1 on a miss
+	//Uses the same formulas as GeometryUtils::HitTest_Sphere/HitTest_Plane, so the distances match the scalar tests
+	//anyHit returns the first hit found instead of the closest one
+	int IntersectSpheres_Scalar(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit);
+	int IntersectSpheres_SSE41(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit);
+	int IntersectSpheres_AVX2(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit);
+	int IntersectPlanes_Scalar(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit);
+	int IntersectPlanes_SSE41(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit);
+	int IntersectPlanes_AVX2(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit);
+
+	//Dispatches on the level the mirror was built for
+	int IntersectSpheres(const SphereSoA& spheres, const Ray& ray, float& t, bool anyHit = false);
+	int IntersectPlanes(const PlaneSoA& planes, const Ray& ray, float& t, bool anyHit = false);
+}
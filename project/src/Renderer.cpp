@@ -6,18 +6,39 @@
 #include "Renderer.h"
 #include "Maths.h"
 #include "Matrix.h"
-#include "Material.h"
+#include "MaterialBatch.h"
 #include "Scene.h"
 #include "Utils.h"
 //#include "Matrix.h"
-#include <execution>
 #include "Vector3.h"
 
+#include <algorithm>
 #include <iostream>
 #define PARALLEL_EXECUTION
 
 using namespace dae;
 
+//R2 low discrepancy sequence in the unit square, index 0 is the center
+static void GetR2Point(int index, float& x, float& y)
+{
+	x = .5f + index * .7548776662f;
+	y = .5f + index * .5698402910f;
+	x -= floorf(x);
+	y -= floorf(y);
+}
+
+//0 is a miss, otherwise materialIndex + 1, neighbours with different ids are on a geometry edge
+static uint16_t GetSurfaceId(const HitRecord& hit)
+{
+	return static_cast<uint16_t>(hit.didHit ? hit.materialIndex + 1 : 0);
+}
+
+//Display referred, so bright highlights do not count as noise
+static float GetDisplayLuminance(const ColorRGB& color)
+{
+	return std::clamp(.2126f * color.r + .7152f * color.g + .0722f * color.b, 0.f, 1.f);
+}
+
 Renderer::Renderer(SDL_Window * pWindow) :
 	m_pWindow(pWindow),
 	m_pBuffer(SDL_GetWindowSurface(pWindow))
@@ -25,79 +46,651 @@ Renderer::Renderer(SDL_Window * pWindow) :
 	//Initialize
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+
+	InitializeFrameBuffer();
+	m_Scheduler.Start();
 }
 
-void Renderer::Render(Scene* pScene) const
+Renderer::Renderer(int width, int height) :
+	m_pBuffer(SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888)),
+	m_OwnsBuffer(true),
+	m_Width(width),
+	m_Height(height)
 {
+	//Plain memory surface, SDL_MapRGB and SDL_SaveBMP work on it without the video subsystem
+	//SDL refuses sizes it cannot allocate, the caller checks HasBuffer and SDL_GetError
+	if (!m_pBuffer)
+	{
+		m_Width = 0;
+		m_Height = 0;
+		return;
+	}
+	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+
+	InitializeFrameBuffer();
+	m_Scheduler.Start();
+}
+
+Renderer::~Renderer()
+{
+	if (m_OwnsBuffer)
+		SDL_FreeSurface(m_pBuffer);
+}
+
+void Renderer::Render(Scene* pScene)
+{
+	pScene->UpdateAccelerationStructure();
+
 	Camera& camera = pScene->GetCamera();
-	const Matrix cameraToWorld = camera.CalculateCameraToWorld();
+	const Matrix cameraToWorld{ camera.CalculateCameraToWorld() };
+	const float fov{ tanf(camera.fovAngle / 2) };
 
-	float aspectRatio{ static_cast<float>(m_Width) / m_Height };
+	//Anything that changes what a pixel sees throws the accumulated samples and the G-buffer away
+	const bool hasViewChanged{ pScene != m_pAccumulatedScene || pScene->GetVersion() != m_AccumulatedSceneVersion ||
+		!(cameraToWorld == m_AccumulatedCameraToWorld) || fov != m_AccumulatedFov };
+	if (hasViewChanged)
+		m_IsGBufferValid = false;
+	if (!m_ProgressiveEnabled || hasViewChanged)
+	{
+		m_NrAccumulatedSamples = 0;
+		m_pAccumulatedScene = pScene;
+		m_AccumulatedSceneVersion = pScene->GetVersion();
+		m_AccumulatedCameraToWorld = cameraToWorld;
+		m_AccumulatedFov = fov;
+	}
+
+	if (m_NrAccumulatedSamples >= MaxAccumulatedSamples)
+	{
+		//Nothing left to trace, but a tone mapping or gamma change still has to show
+		if (m_NeedsResolve)
+			ResolveFrame();
+		if (m_pWindow)
+			SDL_UpdateWindowSurface(m_pWindow);
+		return;
+	}
+
+	//The first sample goes through the pixel center
+	const int sampleIndex{ m_NrAccumulatedSamples };
+	float jitterX{}, jitterY{};
+	GetR2Point(sampleIndex, jitterX, jitterY);
+
+	m_NrAASamples = 0;
+	//Only the shading changed since the G-buffer was filled, so the primary rays are not traced again
+	const bool reshadeOnly{ m_HasShadingChanged && m_IsGBufferValid && sampleIndex == 0 };
+	m_HasShadingChanged = false;
+	if (sampleIndex == 0 && !reshadeOnly)
+		m_GBufferHasVisibility = m_ShadowsEnabled;
+
+	//Read by every pixel, so it is gathered once here instead of copied per pixel
+	const RenderContext context{
+		*pScene,
+		pScene->GetMaterialData(),
+		pScene->GetLights(),
+		cameraToWorld,
+		camera.origin,
+		fov,
+		static_cast<float>(m_Width) / m_Height,
+		1.f / m_Width,
+		1.f / m_Height,
+		jitterX,
+		jitterY,
+		sampleIndex };
+	m_ResolveSettings.scale = 1.f / (sampleIndex + 1);
+
+	const int tilesPerRow{ (m_Width + m_TileSize - 1) / m_TileSize };
+	const int tilesPerColumn{ (m_Height + m_TileSize - 1) / m_TileSize };
+	const uint32_t nrTiles{ static_cast<uint32_t>(tilesPerRow * tilesPerColumn) };
+	auto renderTile{ [&](uint32_t tileIndex)
+		{
+			RenderTile(context, tileIndex);
+		} };
 	
-	const float fovAngle{ camera.fovAngle * TO_RADIANS };
-	const float fov{ tanf(camera.fovAngle/2) };
+	auto reshadeRow{ [&](uint32_t row)
+		{
+			ReshadeRow(context, row);
+		} };
 	
 #if defined(PARALLEL_EXECUTION)
-	uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
-	std::vector<uint32_t> pixelIndices{};
-	pixelIndices.reserve(amountOfPixels);
-	for (uint32_t index{}; index < amountOfPixels; ++index)
-		pixelIndices.emplace_back(index);
-	std::for_each(std::execution::par, pixelIndices.begin(), pixelIndices.end(), [&](int i)
-		{
-			RenderPixel(pScene, i, fov, aspectRatio, cameraToWorld, camera.origin);
-		});
-	
-
-	
+	if (reshadeOnly)
+		m_Scheduler.Run(m_Height, reshadeRow);
+	else if (m_WavefrontEnabled)
+		RenderWavefront(context);
+	else
+		m_Scheduler.Run(nrTiles, renderTile);
 #else
-	uint32_t amountOfPixels{ uint32_t(m_Width * m_Height) };
-
-	for (uint32_t pixelIndex{}; pixelIndex < amountOfPixels; pixelIndex++)
+	if (reshadeOnly)
 	{
-		RenderPixel(pScene, pixelIndex, fov, aspectRatio, cameraToWorld, camera.origin);
+		for (int row{}; row < m_Height; ++row)
+		{
+			reshadeRow(row);
+		}
+	}
+	else if (m_WavefrontEnabled)
+	{
+		RenderWavefront(context);
+	}
+	else
+	{
+		for (uint32_t tileIndex{}; tileIndex < nrTiles; tileIndex++)
+		{
+			renderTile(tileIndex);
+		}
 	}
 #endif
 
+	if (sampleIndex == 0)
+	{
+		m_IsGBufferValid = true;
+		m_GBufferHasVisibility |= m_ShadowsEnabled;
+	}
+
+	//Later samples are jittered over the whole pixel already, only the first one is refined
+	if (m_AntiAliasingEnabled && sampleIndex == 0)
+		AntiAlias(context);
+
+	ResolveFrame();
+	++m_NrAccumulatedSamples;
+
 
 	//@END
 	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	if (m_pWindow)
+		SDL_UpdateWindowSurface(m_pWindow);
 }
 
-void dae::Renderer::RenderPixel(Scene* pScene, int pixelIndex, float fov, float aspectRatio, const Matrix cameraToWorld, const Vector3 cameraOrigin) const
+void dae::Renderer::RenderTile(const RenderContext& context, int tileIndex)
 {
-	auto materials{ pScene->GetMaterials() };
-	auto& lights = pScene->GetLights();
-	const int px{ pixelIndex % m_Width }, py{ pixelIndex / m_Width };
+	const int tilesPerRow{ (m_Width + m_TileSize - 1) / m_TileSize };
+	const int startX{ (tileIndex % tilesPerRow) * m_TileSize };
+	const int startY{ (tileIndex / tilesPerRow) * m_TileSize };
+	//tiles on the right and bottom edge can be cut off
+	const int endX{ std::min(startX + m_TileSize, m_Width) };
+	const int endY{ std::min(startY + m_TileSize, m_Height) };
+
+	if (m_PacketWidth == 1)
+	{
+		for (int py{ startY }; py < endY; ++py)
+		{
+			for (int px{ startX }; px < endX; ++px)
+			{
+				RenderPixel(context, px + py * m_Width);
+			}
+		}
+		return;
+	}
 
-	float rx{ px + 0.5f }, ry{ py + 0.5f };
-	float cx{ (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov };
-	float cy{ (1 - (2 * (ry / float(m_Height)))) * fov };
+	for (int packetY{ startY }; packetY < endY; packetY += m_PacketWidth)
+	{
+		for (int packetX{ startX }; packetX < endX; packetX += m_PacketWidth)
+		{
+			RenderPacket(context, packetX, packetY, std::min(packetX + m_PacketWidth, endX), std::min(packetY + m_PacketWidth, endY));
+		}
+	}
+}
 
-	Vector3 rayDirection{ (2 * ((px + 0.5f) / m_Width) - 1) * aspectRatio * fov,(1 - (2 * ((py + 0.5f)) / m_Height)) * fov,1 };
-	rayDirection.Normalize();
+void dae::Renderer::RenderPixel(const RenderContext& context, int pixelIndex)
+{
+	const int px{ pixelIndex % m_Width }, py{ pixelIndex / m_Width };
+	const Vector3 rayDirection{ GetCameraRayDirection(context, px + context.jitterX, py + context.jitterY) };
 
-	Ray viewRay{ cameraOrigin,cameraToWorld.TransformVector(rayDirection) };
-	ColorRGB finalColor{};
+	Ray viewRay{ context.cameraOrigin,context.cameraToWorld.TransformVector(rayDirection) };
 	HitRecord closestHit{};
 
-	pScene->GetClosestHit(viewRay, closestHit);
+	context.scene.GetClosestHit(viewRay, closestHit);
+	ShadePixel(context, px, py, closestHit, rayDirection);
+}
+
+void dae::Renderer::RenderPacket(const RenderContext& context, int startX, int startY, int endX, int endY)
+{
+	RayPacket packet{};
+	packet.origin = context.cameraOrigin;
+	Vector3 rayDirections[RayPacket::MaxSize];
+	for (int py{ startY }; py < endY; ++py)
+	{
+		for (int px{ startX }; px < endX; ++px)
+		{
+			const int i{ packet.size++ };
+			rayDirections[i] = GetCameraRayDirection(context, px + context.jitterX, py + context.jitterY);
+
+			const Vector3 worldDirection{ context.cameraToWorld.TransformVector(rayDirections[i]) };
+			packet.directionX[i] = worldDirection.x;
+			packet.directionY[i] = worldDirection.y;
+			packet.directionZ[i] = worldDirection.z;
+			packet.max[i] = FLT_MAX;
+		}
+	}
+
+	HitRecord closestHits[RayPacket::MaxSize]{};
+	context.scene.GetClosestHits(packet, closestHits);
+
+	int i{};
+	for (int py{ startY }; py < endY; ++py)
+	{
+		for (int px{ startX }; px < endX; ++px, ++i)
+		{
+			ShadePixel(context, px, py, closestHits[i], rayDirections[i]);
+		}
+	}
+}
+
+void dae::Renderer::RenderWavefront(const RenderContext& context)
+{
+	//Every stage finishes on all threads before the next one starts
+	auto runStage{ [this](uint32_t count, auto& task)
+		{
+#if defined(PARALLEL_EXECUTION)
+			m_Scheduler.Run(count, task);
+#else
+			for (uint32_t i{}; i < count; ++i)
+			{
+				task(i);
+			}
+#endif
+		} };
+
+	const int blocksPerRow{ (m_Width + WavefrontBlockWidth - 1) / WavefrontBlockWidth };
+	const int blocksPerColumn{ (m_Height + WavefrontBlockWidth - 1) / WavefrontBlockWidth };
+	const uint32_t nrBlocks{ static_cast<uint32_t>(blocksPerRow * blocksPerColumn) };
+	m_RayQueue.resize(static_cast<size_t>(nrBlocks) * RayPacket::MaxSize);
+
+	//The G-buffer keeps the center samples for re-shading, jittered samples go next to it
+	if (context.sampleIndex == 0)
+	{
+		m_pWavefrontHits = m_GBuffer.data();
+	}
+	else
+	{
+		m_JitteredHits.resize(m_GBuffer.size());
+		m_pWavefrontHits = m_JitteredHits.data();
+	}
+
+	auto generateRays{ [&](uint32_t blockIndex)
+		{
+			GenerateRays(context, blockIndex);
+		} };
+	runStage(nrBlocks, generateRays);
+
+	auto intersectRays{ [&](uint32_t blockIndex)
+		{
+			IntersectRays(context, blockIndex);
+		} };
+	runStage(nrBlocks, intersectRays);
+
+	//Misses are already written, only the hits go on to the shadow and shading stages
+	m_HitQueue.clear();
+	for (const WavefrontRay& ray : m_RayQueue)
+	{
+		if (ray.pixelIndex >= 0 && m_pWavefrontHits[ray.pixelIndex].hit.didHit)
+			m_HitQueue.push_back(ray.pixelIndex);
+	}
+	const uint32_t nrHitBatches{ static_cast<uint32_t>((m_HitQueue.size() + WavefrontBatchSize - 1) / WavefrontBatchSize) };
+
+	if (m_ShadowsEnabled)
+	{
+		const size_t nrLights{ std::min(context.lights.size(), static_cast<size_t>(MaxGBufferLights)) };
+		m_ShadowRayQueue.resize(m_HitQueue.size() * nrLights);
+		m_ShadowRayResults.resize(m_ShadowRayQueue.size());
+
+		auto generateShadowRays{ [&](uint32_t hitBatchIndex)
+			{
+				GenerateShadowRays(context, hitBatchIndex);
+			} };
+		runStage(nrHitBatches, generateShadowRays);
+
+		//Every batch holds shadow rays of neighbouring hits towards the same light
+		auto traceShadowRays{ [&](uint32_t batchIndex)
+			{
+				TraceShadowRays(context, batchIndex);
+			} };
+		runStage(static_cast<uint32_t>((m_ShadowRayQueue.size() + WavefrontBatchSize - 1) / WavefrontBatchSize), traceShadowRays);
+
+		//The bits of a hit are only written by the batch that owns it, so the stages above never share a pixel between threads
+		auto gatherShadowRays{ [&](uint32_t hitBatchIndex)
+			{
+				GatherShadowRays(hitBatchIndex);
+			} };
+		runStage(nrHitBatches, gatherShadowRays);
+	}
+
+	BinHitsByMaterial(context);
+
+	auto shadeBatch{ [&](uint32_t batchIndex)
+		{
+			ShadeBatch(context, m_ShadeBatches[batchIndex]);
+		} };
+	runStage(static_cast<uint32_t>(m_ShadeBatches.size()), shadeBatch);
+}
+
+void dae::Renderer::GenerateRays(const RenderContext& context, int blockIndex)
+{
+	const int blocksPerRow{ (m_Width + WavefrontBlockWidth - 1) / WavefrontBlockWidth };
+	const int startX{ (blockIndex % blocksPerRow) * WavefrontBlockWidth };
+	const int startY{ (blockIndex / blocksPerRow) * WavefrontBlockWidth };
+
+	WavefrontRay* pRays{ m_RayQueue.data() + static_cast<size_t>(blockIndex) * RayPacket::MaxSize };
+	for (int y{}; y < WavefrontBlockWidth; ++y)
+	{
+		for (int x{}; x < WavefrontBlockWidth; ++x)
+		{
+			WavefrontRay& ray{ pRays[x + y * WavefrontBlockWidth] };
+			const int px{ startX + x }, py{ startY + y };
+			if (px >= m_Width || py >= m_Height)
+			{
+				ray.pixelIndex = -1;
+				continue;
+			}
+			ray.direction = GetCameraRayDirection(context, px + context.jitterX, py + context.jitterY);
+			ray.pixelIndex = px + py * m_Width;
+		}
+	}
+}
+
+void dae::Renderer::IntersectRays(const RenderContext& context, int blockIndex)
+{
+	const WavefrontRay* pRays{ m_RayQueue.data() + static_cast<size_t>(blockIndex) * RayPacket::MaxSize };
+
+	//One block of the queue is one packet, blocks cut off by the frame edge leave their padding out
+	RayPacket packet{};
+	packet.origin = context.cameraOrigin;
+	int packetToQueue[RayPacket::MaxSize];
+	for (int i{}; i < RayPacket::MaxSize; ++i)
+	{
+		if (pRays[i].pixelIndex < 0)
+			continue;
+
+		const Vector3 worldDirection{ context.cameraToWorld.TransformVector(pRays[i].direction) };
+		packet.directionX[packet.size] = worldDirection.x;
+		packet.directionY[packet.size] = worldDirection.y;
+		packet.directionZ[packet.size] = worldDirection.z;
+		packet.max[packet.size] = FLT_MAX;
+		packetToQueue[packet.size++] = i;
+	}
+
+	HitRecord closestHits[RayPacket::MaxSize]{};
+	context.scene.GetClosestHits(packet, closestHits);
+
+	for (int i{}; i < packet.size; ++i)
+	{
+		const WavefrontRay& ray{ pRays[packetToQueue[i]] };
+		closestHits[i].normal.Normalize();
+		m_pWavefrontHits[ray.pixelIndex] = { closestHits[i], ray.direction, 0 };
+
+		if (!closestHits[i].didHit && context.sampleIndex == 0)
+			m_FrameBuffer.SetPixel(ray.pixelIndex, {});
+	}
+}
+
+void dae::Renderer::GenerateShadowRays(const RenderContext& context, int hitBatchIndex)
+{
+	const size_t begin{ static_cast<size_t>(hitBatchIndex) * WavefrontBatchSize };
+	const size_t end{ std::min(begin + WavefrontBatchSize, m_HitQueue.size()) };
+	const size_t nrHits{ m_HitQueue.size() };
+	const size_t nrLights{ std::min(context.lights.size(), static_cast<size_t>(MaxGBufferLights)) };
+
+	for (size_t i{ begin }; i < end; ++i)
+	{
+		const HitRecord& hit{ m_pWavefrontHits[m_HitQueue[i]].hit };
+		const Vector3 offset{ hit.origin + hit.normal * 0.001f };
+		for (size_t lightIndex{}; lightIndex < nrLights; ++lightIndex)
+		{
+			Vector3 lightDirection{ LightUtils::GetDirectionToLight(context.lights[lightIndex], offset) };
+			const float maxDistance{ lightDirection.Normalize() };
+			m_ShadowRayQueue[lightIndex * nrHits + i] = { { offset, lightDirection, 0.0001f, maxDistance }, static_cast<int>(i), static_cast<int>(lightIndex) };
+		}
+	}
+}
+
+void dae::Renderer::TraceShadowRays(const RenderContext& context, int batchIndex)
+{
+	const size_t begin{ static_cast<size_t>(batchIndex) * WavefrontBatchSize };
+	const size_t end{ std::min(begin + WavefrontBatchSize, m_ShadowRayQueue.size()) };
+	for (size_t i{ begin }; i < end; ++i)
+	{
+		const WavefrontShadowRay& shadowRay{ m_ShadowRayQueue[i] };
+		m_ShadowRayResults[i] = IsLightVisible(context, shadowRay.ray, shadowRay.lightIndex);
+	}
+}
+
+void dae::Renderer::GatherShadowRays(int hitBatchIndex)
+{
+	const size_t begin{ static_cast<size_t>(hitBatchIndex) * WavefrontBatchSize };
+	const size_t end{ std::min(begin + WavefrontBatchSize, m_HitQueue.size()) };
+	const size_t nrHits{ m_HitQueue.size() };
+	for (size_t lightIndex{}; lightIndex * nrHits < m_ShadowRayQueue.size(); ++lightIndex)
+	{
+		for (size_t i{ begin }; i < end; ++i)
+		{
+			if (m_ShadowRayResults[lightIndex * nrHits + i])
+				m_pWavefrontHits[m_HitQueue[i]].visibleLights |= uint64_t{ 1 } << lightIndex;
+		}
+	}
+}
+
+void dae::Renderer::BinHitsByMaterial(const RenderContext& context)
+{
+	//Counting sort, keeps the queue order inside every bin
+	const size_t nrMaterials{ context.materials.size() };
+	m_MaterialBins.assign(nrMaterials + 1, 0);
+	for (int pixelIndex : m_HitQueue)
+	{
+		++m_MaterialBins[m_pWavefrontHits[pixelIndex].hit.materialIndex + 1];
+	}
+	for (size_t materialIndex{}; materialIndex < nrMaterials; ++materialIndex)
+	{
+		m_MaterialBins[materialIndex + 1] += m_MaterialBins[materialIndex];
+	}
+
+	m_ShadeQueue.resize(m_HitQueue.size());
+	m_ShadeBatches.clear();
+	for (size_t materialIndex{}; materialIndex < nrMaterials; ++materialIndex)
+	{
+		//A batch never spans two materials
+		for (int begin{ m_MaterialBins[materialIndex] }; begin < m_MaterialBins[materialIndex + 1]; begin += WavefrontBatchSize)
+		{
+			m_ShadeBatches.push_back({ begin, std::min(begin + WavefrontBatchSize, m_MaterialBins[materialIndex + 1]) });
+		}
+	}
+
+	//Moves every bin start along to its end
+	for (int pixelIndex : m_HitQueue)
+	{
+		m_ShadeQueue[m_MaterialBins[m_pWavefrontHits[pixelIndex].hit.materialIndex]++] = pixelIndex;
+	}
+}
+
+void dae::Renderer::ShadeBatch(const RenderContext& context, const WavefrontBatch& batch)
+{
+	const int batchSize{ batch.end - batch.begin };
+	const GBufferPixel* pPixels[WavefrontBatchSize];
+	Vector3 offsets[WavefrontBatchSize];
+
+	//The whole batch has one material, so the BRDF runs as one batch per light
+	ShadingBatch shadingBatch{};
+	shadingBatch.size = batchSize;
+	for (int i{}; i < batchSize; ++i)
+	{
+		pPixels[i] = &m_pWavefrontHits[m_ShadeQueue[batch.begin + i]];
+		const HitRecord& hit{ pPixels[i]->hit };
+		offsets[i] = hit.origin + hit.normal * 0.001f;
+		shadingBatch.normalX[i] = hit.normal.x;
+		shadingBatch.normalY[i] = hit.normal.y;
+		shadingBatch.normalZ[i] = hit.normal.z;
+		shadingBatch.viewX[i] = -pPixels[i]->rayDirection.x;
+		shadingBatch.viewY[i] = -pPixels[i]->rayDirection.y;
+		shadingBatch.viewZ[i] = -pPixels[i]->rayDirection.z;
+	}
+	const MaterialData& material{ context.materials[pPixels[0]->hit.materialIndex] };
+	const bool needsBRDF{ m_CurrentLightingMode == LightingMode::BRDF || m_CurrentLightingMode == LightingMode::Combined };
+
+	ColorRGB finalColors[WavefrontBatchSize]{};
+	for (size_t lightIndex{}; lightIndex < context.lights.size(); ++lightIndex)
+	{
+		const Light& currentLight{ context.lights[lightIndex] };
+		bool isLit[WavefrontBatchSize];
+		float observedAreas[WavefrontBatchSize];
+		for (int i{}; i < batchSize; ++i)
+		{
+			Vector3 lightDirection{ LightUtils::GetDirectionToLight(currentLight,offsets[i]) };
+			lightDirection.Normalize();
+			shadingBatch.lightX[i] = lightDirection.x;
+			shadingBatch.lightY[i] = lightDirection.y;
+			shadingBatch.lightZ[i] = lightDirection.z;
+
+			isLit[i] = !m_ShadowsEnabled || (lightIndex < MaxGBufferLights ? (pPixels[i]->visibleLights >> lightIndex & 1) != 0 : IsLightVisible(context, offsets[i], lightIndex));
+			observedAreas[i] = Vector3::Dot(lightDirection, pPixels[i]->hit.normal);
+		}
+
+		alignas(32) float brdfRed[WavefrontBatchSize];
+		alignas(32) float brdfGreen[WavefrontBatchSize];
+		alignas(32) float brdfBlue[WavefrontBatchSize];
+		if (needsBRDF)
+			dae::ShadeBatch(material, shadingBatch, brdfRed, brdfGreen, brdfBlue);
+
+		//Same sums in the same order as ShadeHit
+		for (int i{}; i < batchSize; ++i)
+		{
+			if (!isLit[i])
+				continue;
+
+			const float observedArea{ observedAreas[i] };
+			switch (m_CurrentLightingMode)
+			{
+			case LightingMode::ObservedArea:
+				if (observedArea >= 0)
+					finalColors[i] += ColorRGB{ observedArea,observedArea,observedArea };
+				break;
+			case LightingMode::Radiance:
+				finalColors[i] += LightUtils::GetRadiance(currentLight, pPixels[i]->hit.origin);
+				break;
+			case LightingMode::BRDF:
+				finalColors[i] += ColorRGB{ brdfRed[i], brdfGreen[i], brdfBlue[i] };
+				break;
+			case LightingMode::Combined:
+				if (observedArea >= 0)
+					finalColors[i] += LightUtils::GetRadiance(currentLight, pPixels[i]->hit.origin) * observedArea * ColorRGB{ brdfRed[i], brdfGreen[i], brdfBlue[i] };
+				break;
+			}
+		}
+	}
+
+	for (int i{}; i < batchSize; ++i)
+	{
+		const int pixelIndex{ m_ShadeQueue[batch.begin + i] };
+		if (context.sampleIndex == 0)
+			m_FrameBuffer.SetPixel(pixelIndex, finalColors[i]);
+		else
+			m_FrameBuffer.AddPixel(pixelIndex, finalColors[i]);
+	}
+}
+
+void dae::Renderer::SetPacketWidth(int packetWidth)
+{
+	//RayPacket::MaxSize rays fit in an 8x8 block
+	m_PacketWidth = std::clamp(packetWidth, 1, 8);
+}
+
+void dae::Renderer::SetTileSize(int tileSize)
+{
+	m_TileSize = std::clamp(tileSize, 1, 256);
+}
+
+void dae::Renderer::SetThreadCount(int nrThreads, bool pinThreads)
+{
+	m_Scheduler.Start(nrThreads, pinThreads);
+}
+
+Vector3 dae::Renderer::GetCameraRayDirection(const RenderContext& context, float x, float y) const
+{
+	const Vector3 rayDirection{ (2 * (x * context.invWidth) - 1) * context.aspectRatio * context.fov,(1 - (2 * y * context.invHeight)) * context.fov,1 };
+	//One per pixel and sample, every render path generates its rays here so they all agree
+	return rayDirection.NormalizedFast();
+}
+
+void dae::Renderer::ShadePixel(const RenderContext& context, int px, int py, HitRecord& closestHit, const Vector3& rayDirection)
+{
+	const int pixelIndex{ px + (py * m_Width) };
 	closestHit.normal.Normalize();
+	const uint64_t visibleLights{ m_ShadowsEnabled ? TraceVisibility(context, closestHit) : 0 };
+	const ColorRGB finalColor{ ShadeHit(context, closestHit, rayDirection, visibleLights) };
+
+	//Stays linear and unclamped, tone mapping happens in the resolve pass
+	if (context.sampleIndex == 0)
+	{
+		m_FrameBuffer.SetPixel(pixelIndex, finalColor);
+		m_GBuffer[pixelIndex] = { closestHit, rayDirection, visibleLights };
+	}
+	else
+	{
+		m_FrameBuffer.AddPixel(pixelIndex, finalColor);
+	}
+}
+
+void dae::Renderer::ReshadeRow(const RenderContext& context, int row)
+{
+	for (int pixelIndex{ row * m_Width }; pixelIndex < (row + 1) * m_Width; ++pixelIndex)
+	{
+		GBufferPixel& pixel{ m_GBuffer[pixelIndex] };
+		//Shadows were off when the G-buffer was filled, the shadow rays are traced once now
+		if (m_ShadowsEnabled && !m_GBufferHasVisibility)
+			pixel.visibleLights = TraceVisibility(context, pixel.hit);
+		m_FrameBuffer.SetPixel(pixelIndex, ShadeHit(context, pixel.hit, pixel.rayDirection, pixel.visibleLights));
+	}
+}
+
+bool dae::Renderer::IsLightVisible(const RenderContext& context, const Vector3& offset, size_t lightIndex) const
+{
+	Vector3 lightDirection{ LightUtils::GetDirectionToLight(context.lights[lightIndex],offset) };
+	const float maxDistance{ lightDirection.Normalize() };
+	Ray lightRay{ offset,lightDirection,0.0001f,maxDistance };
+	return IsLightVisible(context, lightRay, lightIndex);
+}
+
+bool dae::Renderer::IsLightVisible(const RenderContext& context, const Ray& lightRay, size_t lightIndex) const
+{
+	//Neighbouring pixels tend to be shadowed by the same primitive, so every thread keeps the last occluder per light
+	thread_local std::vector<OccluderCache> occluders{};
+	if (occluders.size() < context.lights.size())
+		occluders.resize(context.lights.size());
+
+	return !context.scene.DoesHit(lightRay, occluders[lightIndex]);
+}
+
+uint64_t dae::Renderer::TraceVisibility(const RenderContext& context, const HitRecord& closestHit) const
+{
+	if (!closestHit.didHit)
+		return 0;
+
+	const Vector3 offset{ closestHit.origin + closestHit.normal * 0.001f };
+	const size_t nrLights{ std::min(context.lights.size(), static_cast<size_t>(MaxGBufferLights)) };
+	uint64_t visibleLights{};
+	for (size_t lightIndex{}; lightIndex < nrLights; ++lightIndex)
+	{
+		if (IsLightVisible(context, offset, lightIndex))
+			visibleLights |= uint64_t{ 1 } << lightIndex;
+	}
+	return visibleLights;
+}
+
+ColorRGB dae::Renderer::ShadeHit(const RenderContext& context, const HitRecord& closestHit, const Vector3& rayDirection, uint64_t visibleLights) const
+{
+	const std::vector<Light>& lights{ context.lights };
+	ColorRGB finalColor{};
 
 	if (closestHit.didHit)
 	{
 		const Vector3 offset{ closestHit.origin + closestHit.normal * 0.001f };
 
-		for (const Light& currentLight : lights)
+		for (size_t lightIndex{}; lightIndex < lights.size(); ++lightIndex)
 		{
+			const Light& currentLight{ lights[lightIndex] };
 			Vector3 lightDirection{ LightUtils::GetDirectionToLight(currentLight,offset) };
-			float maxDistance{ lightDirection.Normalize() };
+			lightDirection.Normalize();
 
 			if (m_ShadowsEnabled)
 			{
-				Ray lightRay{ offset,lightDirection,0.0001f,maxDistance };
-				if (pScene->DoesHit(lightRay))
+				//Lights past the ones the G-buffer has bits for are tested here
+				const bool isVisible{ lightIndex < MaxGBufferLights ? (visibleLights >> lightIndex & 1) != 0 : IsLightVisible(context, offset, lightIndex) };
+				if (!isVisible)
 				{
 					//finalColor *= 0.5f;
 					continue;
@@ -118,29 +711,232 @@ void dae::Renderer::RenderPixel(Scene* pScene, int pixelIndex, float fov, float
 				finalColor += radiance;
 				break;
 			case dae::Renderer::LightingMode::BRDF:
-				finalColor += materials[closestHit.materialIndex]->Shade(closestHit, lightDirection, -rayDirection);
+				finalColor += ShadeMaterial(context.materials[closestHit.materialIndex], closestHit.normal, lightDirection, -rayDirection);
 				break;
 			case dae::Renderer::LightingMode::Combined:
 				if (observedArea < 0)
 					continue;
-				finalColor += radiance * observedArea * materials[closestHit.materialIndex]->Shade(closestHit, lightDirection, -rayDirection);
+				finalColor += radiance * observedArea * ShadeMaterial(context.materials[closestHit.materialIndex], closestHit.normal, lightDirection, -rayDirection);
 				break;
 			}
 		}
 	}
-	finalColor.MaxToOne();
+	return finalColor;
+}
+
+void dae::Renderer::AntiAlias(const RenderContext& context)
+{
+	m_AAPixels.resize(static_cast<size_t>(m_Width) * m_Height);
+	auto scoreRow{ [&](uint32_t row)
+		{
+			ScoreAARow(row);
+		} };
+
+#if defined(PARALLEL_EXECUTION)
+	m_Scheduler.Run(m_Height, scoreRow);
+#else
+	for (int row{}; row < m_Height; ++row)
+	{
+		scoreRow(row);
+	}
+#endif
+
+	SelectAAPixels();
+
+	//Small batches, edge pixels cluster on a few rows
+	constexpr int batchSize{ 32 };
+	const uint32_t nrBatches{ static_cast<uint32_t>((m_AAPixels.size() + batchSize - 1) / batchSize) };
+	auto refineBatch{ [&](uint32_t batchIndex)
+		{
+			const size_t end{ std::min(m_AAPixels.size(), static_cast<size_t>(batchIndex + 1) * batchSize) };
+			for (size_t i{ static_cast<size_t>(batchIndex) * batchSize }; i < end; ++i)
+			{
+				RefinePixel(context, m_AAPixels[i]);
+			}
+		} };
+
+#if defined(PARALLEL_EXECUTION)
+	m_Scheduler.Run(nrBatches, refineBatch);
+#else
+	for (uint32_t batchIndex{}; batchIndex < nrBatches; ++batchIndex)
+	{
+		refineBatch(batchIndex);
+	}
+#endif
+}
+
+void dae::Renderer::ScoreAARow(int row)
+{
+	//Normals that differ by more than ~25 degrees are a crease or a silhouette
+	constexpr float minSurfaceCosine{ .9f };
+
+	for (int px{}; px < m_Width; ++px)
+	{
+		const int pixelIndex{ px + row * m_Width };
+		const HitRecord& center{ m_GBuffer[pixelIndex].hit };
+		const uint16_t centerId{ GetSurfaceId(center) };
+
+		bool isEdge{ false };
+		float luminanceSum{};
+		float luminanceSquaredSum{};
+		int nrNeighbours{};
+		for (int y{ std::max(row - 1, 0) }; y <= std::min(row + 1, m_Height - 1); ++y)
+		{
+			for (int x{ std::max(px - 1, 0) }; x <= std::min(px + 1, m_Width - 1); ++x)
+			{
+				const int neighbourIndex{ x + y * m_Width };
+				const HitRecord& neighbour{ m_GBuffer[neighbourIndex].hit };
+				isEdge |= GetSurfaceId(neighbour) != centerId || (centerId != 0 && Vector3::Dot(center.normal, neighbour.normal) < minSurfaceCosine);
+
+				const float luminance{ GetDisplayLuminance(m_FrameBuffer.GetPixel(neighbourIndex)) };
+				luminanceSum += luminance;
+				luminanceSquaredSum += luminance * luminance;
+				++nrNeighbours;
+			}
+		}
+
+		const float mean{ luminanceSum / nrNeighbours };
+		const float variance{ std::max(luminanceSquaredSum / nrNeighbours - mean * mean, 0.f) };
+
+		int nrSamples{};
+		if (isEdge || variance > 4 * m_AAVarianceThreshold)
+			nrSamples = MaxAASamples;
+		else if (variance > m_AAVarianceThreshold)
+			nrSamples = MinAASamples;
+
+		//The variance of values in [0, 1] stays below .25, so every edge ranks above every noisy pixel
+		m_AAPixels[pixelIndex] = { pixelIndex, nrSamples, isEdge ? 1.f + variance : variance };
+	}
+}
+
+void dae::Renderer::SelectAAPixels()
+{
+	auto hasNoSamples{ [](const AAPixel& pixel) { return pixel.nrSamples == 0; } };
+	m_AAPixels.erase(std::remove_if(m_AAPixels.begin(), m_AAPixels.end(), hasNoSamples), m_AAPixels.end());
+
+	int64_t nrSamples{};
+	for (const AAPixel& pixel : m_AAPixels)
+	{
+		nrSamples += pixel.nrSamples;
+	}
+
+	const int64_t budget{ static_cast<int64_t>(m_AASampleBudget * m_Width * m_Height) };
+	if (nrSamples > budget)
+	{
+		//Highest scores first, ties in pixel order so the selection is the same every run
+		std::sort(m_AAPixels.begin(), m_AAPixels.end(), [](const AAPixel& a, const AAPixel& b)
+			{
+				return a.score != b.score ? a.score > b.score : a.pixelIndex < b.pixelIndex;
+			});
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+		nrSamples = 0;
+		for (AAPixel& pixel : m_AAPixels)
+		{
+			//Pixels that do not fit anymore get the small pattern while there is room for it
+			if (nrSamples + pixel.nrSamples > budget)
+				pixel.nrSamples = nrSamples + MinAASamples <= budget ? MinAASamples : 0;
+			nrSamples += pixel.nrSamples;
+		}
+
+		m_AAPixels.erase(std::remove_if(m_AAPixels.begin(), m_AAPixels.end(), hasNoSamples), m_AAPixels.end());
+		//Back in pixel order, neighbouring pixels in a batch hit the same part of the scene
+		std::sort(m_AAPixels.begin(), m_AAPixels.end(), [](const AAPixel& a, const AAPixel& b) { return a.pixelIndex < b.pixelIndex; });
+	}
+
+	m_NrAASamples = static_cast<int>(nrSamples);
+}
+
+void dae::Renderer::RefinePixel(const RenderContext& context, const AAPixel& pixel)
+{
+	const int px{ pixel.pixelIndex % m_Width }, py{ pixel.pixelIndex / m_Width };
+	const int gridSize{ pixel.nrSamples == MaxAASamples ? 4 : 2 };
+	const float cellSize{ 1.f / gridSize };
+
+	//All samples of a pixel start at the camera and stay close together, so they are traced as one packet
+	RayPacket packet{};
+	packet.origin = context.cameraOrigin;
+	Vector3 rayDirections[MaxAASamples];
+	for (int i{}; i < pixel.nrSamples; ++i)
+	{
+		//One sample per cell of the grid, jittered inside it so the grid does not line up with edges
+		float jitterX{}, jitterY{};
+		GetR2Point(i + 1, jitterX, jitterY);
+		const float x{ px + (i % gridSize + jitterX) * cellSize };
+		const float y{ py + (i / gridSize + jitterY) * cellSize };
+		rayDirections[i] = GetCameraRayDirection(context, x, y);
+
+		const Vector3 worldDirection{ context.cameraToWorld.TransformVector(rayDirections[i]) };
+		packet.directionX[i] = worldDirection.x;
+		packet.directionY[i] = worldDirection.y;
+		packet.directionZ[i] = worldDirection.z;
+		packet.max[i] = FLT_MAX;
+	}
+	packet.size = pixel.nrSamples;
+
+	HitRecord closestHits[MaxAASamples]{};
+	context.scene.GetClosestHits(packet, closestHits);
+
+	//The center sample from the first pass counts as well
+	ColorRGB colorSum{ m_FrameBuffer.GetPixel(pixel.pixelIndex) };
+	for (int i{}; i < pixel.nrSamples; ++i)
+	{
+		closestHits[i].normal.Normalize();
+		const uint64_t visibleLights{ m_ShadowsEnabled ? TraceVisibility(context, closestHits[i]) : 0 };
+		colorSum += ShadeHit(context, closestHits[i], rayDirections[i], visibleLights);
+	}
+	m_FrameBuffer.SetPixel(pixel.pixelIndex, colorSum / static_cast<float>(pixel.nrSamples + 1));
+}
+
+void dae::Renderer::InitializeFrameBuffer()
+{
+	m_FrameBuffer.Resize(m_Width, m_Height);
+	m_GBuffer.resize(static_cast<size_t>(m_Width) * m_Height);
+
+	const SDL_PixelFormat* pFormat{ m_pBuffer->format };
+	m_MapEveryPixel = pFormat->BytesPerPixel != 4 || pFormat->Rloss != 0 || pFormat->Gloss != 0 || pFormat->Bloss != 0;
+	if (!m_MapEveryPixel)
+		m_ResolveSettings.layout = { pFormat->Rshift, pFormat->Gshift, pFormat->Bshift, pFormat->Amask };
 }
 
+void dae::Renderer::ResolveRow(int row)
+{
+	const int firstPixel{ row * m_Width };
+	m_FrameBuffer.Resolve(m_pBufferPixels, firstPixel, m_Width, m_ResolveSettings);
+	if (!m_MapEveryPixel)
+		return;
+
+	//The default layout is 0x00RRGGBB, SDL converts that to the surface format
+	for (int i{ firstPixel }; i < firstPixel + m_Width; ++i)
+	{
+		const uint32_t pixel{ m_pBufferPixels[i] };
+		m_pBufferPixels[i] = SDL_MapRGB(m_pBuffer->format,
+			static_cast<uint8_t>(pixel >> 16),
+			static_cast<uint8_t>(pixel >> 8),
+			static_cast<uint8_t>(pixel));
+	}
+}
 
+void dae::Renderer::ResolveFrame()
+{
+	auto resolveRow{ [&](uint32_t row)
+		{
+			ResolveRow(row);
+		} };
+
+#if defined(PARALLEL_EXECUTION)
+	m_Scheduler.Run(m_Height, resolveRow);
+#else
+	for (int row{}; row < m_Height; ++row)
+	{
+		resolveRow(row);
+	}
+#endif
+	m_NeedsResolve = false;
+}
 
-bool Renderer::SaveBufferToImage() const
+bool Renderer::SaveBufferToImage(const char* filePath) const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return SDL_SaveBMP(m_pBuffer, filePath);
 }
 
 void dae::Renderer::CycleLightingMode()
@@ -149,6 +945,7 @@ void dae::Renderer::CycleLightingMode()
 	const int maxLightingMode{ static_cast<int>(LightingMode::Combined) + 1 };
 
 	m_CurrentLightingMode = static_cast<LightingMode>(++currentLightingMode % maxLightingMode);
+	RequestReshade();
 
 	if (m_CurrentLightingMode == LightingMode::ObservedArea)
 	{
@@ -167,3 +964,26 @@ void dae::Renderer::CycleLightingMode()
 		std::cout << "Radiance" << std::endl;
 	}
 }
+
+void dae::Renderer::CycleToneMapping()
+{
+	const int maxToneMapping{ static_cast<int>(ToneMapping::ACES) + 1 };
+	m_ResolveSettings.toneMapping = static_cast<ToneMapping>((static_cast<int>(m_ResolveSettings.toneMapping) + 1) % maxToneMapping);
+	m_NeedsResolve = true;
+
+	switch (m_ResolveSettings.toneMapping)
+	{
+	case ToneMapping::MaxToOne:
+		std::cout << "MaxToOne" << std::endl;
+		break;
+	case ToneMapping::Clamp:
+		std::cout << "Clamp" << std::endl;
+		break;
+	case ToneMapping::Reinhard:
+		std::cout << "Reinhard" << std::endl;
+		break;
+	case ToneMapping::ACES:
+		std::cout << "ACES" << std::endl;
+		break;
+	}
+}
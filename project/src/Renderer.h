@@ -1,7 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <vector>
+#include "DataTypes.h"
+#include "FrameBuffer.h"
+#include "MaterialBatch.h"
 #include "Matrix.h"
+#include "TileScheduler.h"
 
 
 struct SDL_Window;
@@ -10,32 +16,195 @@ struct SDL_Surface;
 namespace dae
 {
 	class Scene;
+	struct Light;
 	//class Matrix;
+
+	//Everything the per-pixel kernels read, built once at the start of a frame and never changed while it renders
+	struct RenderContext
+	{
+		const Scene& scene;
+		const std::vector<MaterialData>& materials;
+		const std::vector<Light>& lights;
+
+		Matrix cameraToWorld;
+		Vector3 cameraOrigin;
+		float fov;
+		float aspectRatio;
+		float invWidth;
+		float invHeight;
+
+		//Position of the sample inside the pixel, (.5, .5) is the center
+		float jitterX;
+		float jitterY;
+		//0 overwrites the framebuffer, later samples are added to it
+		int sampleIndex;
+	};
+
 	class Renderer final
 	{
 	public:
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		//Headless: renders into a framebuffer the renderer owns, no window or display needed
+		Renderer(int width, int height);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
+		void Render(Scene* pScene);
 
-		void RenderPixel(Scene* pScene, int pixelIndex, float fov, float aspectRatio, const Matrix cameraToWorld, const Vector3 cameraOrigin)const;
+		//Renders one tileSize x tileSize block, in packets or pixel by pixel
+		void RenderTile(const RenderContext& context, int tileIndex);
+		void RenderPixel(const RenderContext& context, int pixelIndex);
+		//Traces the primary rays of the pixels in [startX, endX) x [startY, endY) together, at most RayPacket::MaxSize of them
+		void RenderPacket(const RenderContext& context, int startX, int startY, int endX, int endY);
 
-		bool SaveBufferToImage() const;
+		//False when the headless surface could not be created, nothing can be rendered then
+		bool HasBuffer() const { return m_pBuffer != nullptr; }
+		//Returns true when saving failed (SDL_SaveBMP result)
+		bool SaveBufferToImage(const char* filePath = "RayTracing_Buffer.bmp") const;
 
 		void CycleLightingMode();
-		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		//Lighting and shadow changes re-light the G-buffer instead of tracing the camera rays again
+		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; RequestReshade(); }
+		//Only change how the samples are resolved, a converged image is resolved again instead of traced
+		void CycleToneMapping();
+		void ToggleGammaCorrection() { m_ResolveSettings.gammaCorrection = !m_ResolveSettings.gammaCorrection; m_NeedsResolve = true; }
+		//Keeps adding jittered samples while the camera and scene stay the same and shows their average
+		void ToggleProgressive() { m_ProgressiveEnabled = !m_ProgressiveEnabled; ResetAccumulation(); }
+		void SetProgressive(bool isEnabled) { m_ProgressiveEnabled = isEnabled; ResetAccumulation(); }
+		void ResetAccumulation() { m_NrAccumulatedSamples = 0; }
+		int GetNrAccumulatedSamples() const { return m_NrAccumulatedSamples; }
+		//Adds stratified samples to pixels on edges and in noisy neighbourhoods, on top of the one through the center
+		void ToggleAntiAliasing() { m_AntiAliasingEnabled = !m_AntiAliasingEnabled; ResetAccumulation(); }
+		void SetAntiAliasing(bool isEnabled) { m_AntiAliasingEnabled = isEnabled; ResetAccumulation(); }
+		//Extra samples one frame may trace, as a multiple of the pixel count
+		void SetAASampleBudget(float samplesPerPixel) { m_AASampleBudget = std::max(samplesPerPixel, 0.f); ResetAccumulation(); }
+		//Extra samples the anti-aliasing pass traced in the last frame
+		int GetNrAASamples() const { return m_NrAASamples; }
+		const FrameBuffer& GetFrameBuffer() const { return m_FrameBuffer; }
+		//Renders the frame in stages instead of pixel by pixel, gives the same image
+		void ToggleWavefront() { m_WavefrontEnabled = !m_WavefrontEnabled; }
+		void SetWavefront(bool isEnabled) { m_WavefrontEnabled = isEnabled; }
+		//2, 4 or 8 traces 2x2, 4x4 or 8x8 packets, 1 traces every pixel on its own
+		void SetPacketWidth(int packetWidth);
+		//Edge length in pixels of the blocks handed to the render threads, best kept a multiple of the packet width
+		void SetTileSize(int tileSize);
+		//0 threads uses every hardware thread, pinning keeps every render thread on its own core
+		void SetThreadCount(int nrThreads, bool pinThreads = false);
 
 	private:
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pBuffer{};
 		uint32_t* m_pBufferPixels{};
+		//Headless buffers are created by the renderer, window surfaces belong to SDL
+		bool m_OwnsBuffer{ false };
+		//Surfaces that are not 8 bits per channel in 32 bits go through SDL_MapRGB per pixel
+		bool m_MapEveryPixel{ false };
+
+		//The tracer writes linear radiance here, Resolve turns it into surface pixels
+		FrameBuffer m_FrameBuffer{};
+		ResolveSettings m_ResolveSettings{};
+
+		//A converged image is kept on screen instead of being traced again
+		static constexpr int MaxAccumulatedSamples{ 256 };
+		bool m_ProgressiveEnabled{ true };
+		int m_NrAccumulatedSamples{};
+		//Set when the resolve settings changed after the last resolve
+		bool m_NeedsResolve{ false };
+		//What the accumulated samples were traced with
+		const Scene* m_pAccumulatedScene{ nullptr };
+		uint64_t m_AccumulatedSceneVersion{};
+		Matrix m_AccumulatedCameraToWorld{};
+		float m_AccumulatedFov{};
+
+		//What the center sample of a pixel hit, enough to shade it again without tracing
+		//Also where the anti-aliasing pass looks for geometry edges
+		struct GBufferPixel
+		{
+			HitRecord hit;
+			//Camera space, the materials are shaded with this view direction
+			Vector3 rayDirection;
+			//Bit i is set when light i reaches the hit point
+			uint64_t visibleLights;
+		};
+
+		//Lights past this many are shadow tested every time they are shaded
+		static constexpr int MaxGBufferLights{ 64 };
+		std::vector<GBufferPixel> m_GBuffer{};
+		//Filled for the current camera and scene
+		bool m_IsGBufferValid{ false };
+		//The visibility bits are only traced while shadows are on
+		bool m_GBufferHasVisibility{ false };
+		bool m_HasShadingChanged{ false };
+
+		//Wavefront pipeline: every stage runs over the whole frame before the next one starts
+		//camera rays -> ray queue -> packet intersection into the hit buffer -> hit queue -> shadow ray queue -> shadow rays
+		//-> visibility bits -> bins per material -> shading
+		struct WavefrontRay
+		{
+			//Camera space
+			Vector3 direction;
+			//-1 pads blocks cut off by the frame edge
+			int pixelIndex;
+		};
+
+		//Ray from a hit towards one light, the queue holds all hits for light 0, then all hits for light 1, ...
+		struct WavefrontShadowRay
+		{
+			Ray ray;
+			//Position in the hit queue
+			int hitIndex;
+			int lightIndex;
+		};
+
+		//Range of m_ShadeQueue with hits of one material
+		struct WavefrontBatch
+		{
+			int begin;
+			int end;
+		};
+
+		//The ray queue is filled per 8x8 block of pixels, so every block is one coherent packet
+		static constexpr int WavefrontBlockWidth{ 8 };
+		static_assert(WavefrontBlockWidth * WavefrontBlockWidth == RayPacket::MaxSize);
+		static constexpr int WavefrontBatchSize{ 64 };
+		static_assert(WavefrontBatchSize <= ShadingBatch::MaxSize);
+		bool m_WavefrontEnabled{ false };
+		std::vector<WavefrontRay> m_RayQueue{};
+		//Pixel indices of the rays that hit something, in ray queue order
+		std::vector<int> m_HitQueue{};
+		std::vector<WavefrontShadowRay> m_ShadowRayQueue{};
+		//1 when the shadow ray at the same position in the queue reached its light
+		std::vector<uint8_t> m_ShadowRayResults{};
+		//The hit queue sorted by material
+		std::vector<int> m_ShadeQueue{};
+		std::vector<int> m_MaterialBins{};
+		std::vector<WavefrontBatch> m_ShadeBatches{};
+		//Where the stages keep their hits, the G-buffer for the first sample and m_JitteredHits for the others
+		GBufferPixel* m_pWavefrontHits{ nullptr };
+		std::vector<GBufferPixel> m_JitteredHits{};
+
+		struct AAPixel
+		{
+			int pixelIndex;
+			int nrSamples;
+			//Edges score above 1, otherwise the luminance variance of the neighbourhood
+			float score;
+		};
+
+		//Pixels get 4 (2x2) or 16 (4x4) extra samples
+		static constexpr int MinAASamples{ 4 };
+		static constexpr int MaxAASamples{ 16 };
+		bool m_AntiAliasingEnabled{ false };
+		float m_AASampleBudget{ 1.f };
+		//Luminance variance of the 3x3 neighbourhood above which a pixel gets extra samples, 4x this gets the most
+		float m_AAVarianceThreshold{ .002f };
+		int m_NrAASamples{};
+		std::vector<AAPixel> m_AAPixels{};
 
 		int m_Width{};
 		int m_Height{};
@@ -50,5 +219,42 @@ namespace dae
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
+		int m_PacketWidth{ 4 };
+		int m_TileSize{ 16 };
+
+		TileScheduler m_Scheduler{};
+
+		//x and y are in pixels, the center of the top left pixel is (.5, .5)
+		Vector3 GetCameraRayDirection(const RenderContext& context, float x, float y) const;
+		bool IsLightVisible(const RenderContext& context, const Vector3& offset, size_t lightIndex) const;
+		bool IsLightVisible(const RenderContext& context, const Ray& lightRay, size_t lightIndex) const;
+		uint64_t TraceVisibility(const RenderContext& context, const HitRecord& closestHit) const;
+		//Lights without their bit in visibleLights are in shadow, only read while shadows are on
+		ColorRGB ShadeHit(const RenderContext& context, const HitRecord& closestHit, const Vector3& rayDirection, uint64_t visibleLights) const;
+		//Shades the camera ray hit of a pixel, the first sample also goes into the G-buffer
+		void ShadePixel(const RenderContext& context, int px, int py, HitRecord& closestHit, const Vector3& rayDirection);
+		void ReshadeRow(const RenderContext& context, int row);
+		void RequestReshade() { m_HasShadingChanged = true; ResetAccumulation(); }
+
+		void RenderWavefront(const RenderContext& context);
+		void GenerateRays(const RenderContext& context, int blockIndex);
+		void IntersectRays(const RenderContext& context, int blockIndex);
+		//Fills the shadow rays of one batch of the hit queue
+		void GenerateShadowRays(const RenderContext& context, int hitBatchIndex);
+		//Traces one batch of the shadow ray queue
+		void TraceShadowRays(const RenderContext& context, int batchIndex);
+		//Sets the visibility bits of one batch of the hit queue from the traced shadow rays
+		void GatherShadowRays(int hitBatchIndex);
+		void BinHitsByMaterial(const RenderContext& context);
+		void ShadeBatch(const RenderContext& context, const WavefrontBatch& batch);
+		//Refines the pixels the first sample left on edges, within the sample budget
+		void AntiAlias(const RenderContext& context);
+		void ScoreAARow(int row);
+		void SelectAAPixels();
+		void RefinePixel(const RenderContext& context, const AAPixel& pixel);
+		void InitializeFrameBuffer();
+		//Tonemaps and packs one row of the float framebuffer into the surface
+		void ResolveRow(int row);
+		void ResolveFrame();
 	};
 }
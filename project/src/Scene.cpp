@@ -12,6 +12,7 @@ namespace dae {
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
+		m_TriangleMeshInstances.reserve(32);
 		m_Lights.reserve(32);
 	}
 
@@ -24,56 +25,334 @@ namespace dae {
 		}
 
 		m_Materials.clear();
+
+		for (auto& pGeometry : m_MeshGeometries)
+		{
+			delete pGeometry;
+			pGeometry = nullptr;
+		}
+
+		m_MeshGeometries.clear();
+	}
+
+	//Hit records for the SoA kernels, filled the same way as GeometryUtils::HitTest_Sphere/HitTest_Plane
+	static void StoreSphereHit(const Sphere& sphere, const Ray& ray, float t, HitRecord& hitRecord)
+	{
+		hitRecord.t = t;
+		hitRecord.didHit = true;
+		hitRecord.materialIndex = sphere.materialIndex;
+		hitRecord.origin = ray.origin + ray.direction * t;
+		hitRecord.normal = hitRecord.origin - sphere.origin;
+	}
+
+	static void StorePlaneHit(const Plane& plane, const Ray& ray, float t, HitRecord& hitRecord)
+	{
+		hitRecord.t = t;
+		hitRecord.origin = ray.origin + t * ray.direction;
+		hitRecord.didHit = true;
+		hitRecord.materialIndex = plane.materialIndex;
+		hitRecord.normal = plane.normal;
+	}
+
+	//FNV-1a, only used on structs of floats and integers without padding
+	static void HashBytes(uint64_t& hash, const void* pData, size_t size)
+	{
+		const unsigned char* pBytes{ static_cast<const unsigned char*>(pData) };
+		for (size_t i{}; i < size; ++i)
+		{
+			hash = (hash ^ pBytes[i]) * 1099511628211ull;
+		}
+	}
+
+	template<typename T>
+	static void HashValue(uint64_t& hash, const T& value)
+	{
+		HashBytes(hash, &value, sizeof(T));
+	}
+
+	uint64_t Scene::HashState() const
+	{
+		uint64_t hash{ 14695981039346656037ull };
+		for (const Plane& plane : m_PlaneGeometries)
+		{
+			HashValue(hash, plane.origin);
+			HashValue(hash, plane.normal);
+			HashValue(hash, plane.materialIndex);
+		}
+		for (const Sphere& sphere : m_SphereGeometries)
+		{
+			HashValue(hash, sphere.origin);
+			HashValue(hash, sphere.radius);
+			HashValue(hash, sphere.materialIndex);
+		}
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			HashValue(hash, mesh.worldTransform);
+			HashValue(hash, mesh.triangles.size());
+			HashValue(hash, mesh.materialIndex);
+			HashValue(hash, mesh.cullMode);
+		}
+		for (const TriangleMeshInstance& instance : m_TriangleMeshInstances)
+		{
+			HashValue(hash, instance.worldTransform);
+			HashValue(hash, instance.pGeometry);
+			HashValue(hash, instance.materialIndex);
+			HashValue(hash, instance.cullMode);
+		}
+		for (const Light& light : m_Lights)
+		{
+			HashValue(hash, light.origin);
+			HashValue(hash, light.direction);
+			HashValue(hash, light.color);
+			HashValue(hash, light.intensity);
+			HashValue(hash, light.type);
+		}
+		HashValue(hash, m_Materials.size());
+		return hash;
+	}
+
+	void Scene::UpdateAccelerationStructure()
+	{
+		//Progressive rendering keeps accumulating as long as this stays the same
+		const uint64_t stateHash{ HashState() };
+		if (stateHash != m_StateHash)
+		{
+			m_StateHash = stateHash;
+			++m_Version;
+		}
+
+		m_MaterialData.clear();
+		for (const Material* pMaterial : m_Materials)
+		{
+			m_MaterialData.push_back(pMaterial->GetData());
+		}
+
+		m_SceneObjects.clear();
+		m_SceneObjectBounds.clear();
+
+		m_PlaneSoA.Build(m_PlaneGeometries);
+		//A handful of spheres is cheaper to test in one SIMD sweep than through the BVH
+		const bool useSphereSoA{ m_SphereGeometries.size() <= MaxSoASpheres };
+		if (useSphereSoA)
+			m_SphereSoA.Build(m_SphereGeometries);
+		else
+			m_SphereSoA.Clear();
+
+		for (uint32_t i{}; !useSphereSoA && i < m_SphereGeometries.size(); ++i)
+		{
+			const Sphere& sphere{ m_SphereGeometries[i] };
+			const Vector3 extent{ sphere.radius, sphere.radius, sphere.radius };
+			m_SceneObjects.push_back({ SceneObjectType::Sphere, i });
+			m_SceneObjectBounds.push_back({ sphere.origin - extent, sphere.origin + extent });
+		}
+
+		for (uint32_t i{}; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[i] };
+			if (mesh.bvh.IsEmpty())
+				continue;
+
+			m_SceneObjects.push_back({ SceneObjectType::TriangleMesh, i });
+			m_SceneObjectBounds.push_back({ mesh.transformedMinAABB, mesh.transformedMaxAABB });
+		}
+
+		for (uint32_t i{}; i < m_TriangleMeshInstances.size(); ++i)
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[i] };
+			if (instance.pGeometry->bvh.IsEmpty())
+				continue;
+
+			m_SceneObjects.push_back({ SceneObjectType::TriangleMeshInstance, i });
+			m_SceneObjectBounds.push_back({ instance.transformedMinAABB, instance.transformedMaxAABB });
+		}
+
+		m_SceneBVH.Update(m_SceneObjectBounds);
+		m_SceneWideBVH.Update(m_SceneBVH);
 	}
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
 		//todo W1
-		//std::vector<float> listOfHits;
-		for (const Sphere& sphere : m_SphereGeometries)
+		//The closest plane and sphere already bound the ray, the BVH only has to look in front of them
+		Ray closestRay{ ray };
+		closestRay.max = std::min(ray.max, closestHit.t);
+
+		float t{};
+		const int planeIndex{ IntersectPlanes(m_PlaneSoA, closestRay, t) };
+		if (planeIndex >= 0)
 		{
-			GeometryUtils::HitTest_Sphere(sphere, ray, closestHit);
+			StorePlaneHit(m_PlaneGeometries[planeIndex], ray, t, closestHit);
+			closestRay.max = t;
 		}
-		for (const Plane& plane : m_PlaneGeometries)
+
+		const int sphereIndex{ IntersectSpheres(m_SphereSoA, closestRay, t) };
+		if (sphereIndex >= 0)
 		{
-			GeometryUtils::HitTest_Plane(plane, ray, closestHit);
+			StoreSphereHit(m_SphereGeometries[sphereIndex], ray, t, closestHit);
+			closestRay.max = t;
 		}
-		//for (const Triangle& Triangle : m_Triangles)
-		//{
-		//	GeometryUtils::HitTest_Triangle(Triangle, ray, closestHit);
-		//}
-		for (const TriangleMesh& triangleMesh : m_TriangleMeshGeometries)
+
+		GeometryUtils::TraverseWideBVH(m_SceneWideBVH, closestRay, false, [&](uint32_t objectIndex)
+			{
+				const SceneObjectRef& object{ m_SceneObjects[objectIndex] };
+				bool hit{ false };
+				switch (object.type)
+				{
+				case SceneObjectType::Sphere:
+					hit = GeometryUtils::HitTest_Sphere(m_SphereGeometries[object.index], closestRay, closestHit);
+					break;
+				case SceneObjectType::TriangleMesh:
+					hit = GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[object.index], closestRay, closestHit);
+					break;
+				case SceneObjectType::TriangleMeshInstance:
+					hit = GeometryUtils::HitTest_TriangleMeshInstance(m_TriangleMeshInstances[object.index], closestRay, closestHit);
+					break;
+				}
+
+				if (hit)
+					closestRay.max = closestHit.t;
+				return hit;
+			});
+	}
+
+	void Scene::GetClosestHits(RayPacket& packet, HitRecord* hitRecords) const
+	{
+		for (int i{}; i < packet.size; ++i)
 		{
-			GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray, closestHit);
+			Ray ray{ packet.GetRay(i) };
+			ray.max = std::min(ray.max, hitRecords[i].t);
+
+			float t{};
+			const int planeIndex{ IntersectPlanes(m_PlaneSoA, ray, t) };
+			if (planeIndex >= 0)
+			{
+				StorePlaneHit(m_PlaneGeometries[planeIndex], ray, t, hitRecords[i]);
+				ray.max = t;
+			}
+
+			const int sphereIndex{ IntersectSpheres(m_SphereSoA, ray, t) };
+			if (sphereIndex >= 0)
+			{
+				StoreSphereHit(m_SphereGeometries[sphereIndex], ray, t, hitRecords[i]);
+				ray.max = t;
+			}
+			packet.max[i] = ray.max;
 		}
-		//throw std::runtime_error("Not Implemented Yet");
+
+		//Nodes are culled for the whole packet, the primitives in the leaves are tested per ray
+		GeometryUtils::TraverseBVHPacket(m_SceneBVH, packet, [&](uint32_t objectIndex)
+			{
+				const SceneObjectRef& object{ m_SceneObjects[objectIndex] };
+				switch (object.type)
+				{
+				case SceneObjectType::Sphere:
+					for (int i{}; i < packet.size; ++i)
+					{
+						if (GeometryUtils::HitTest_Sphere(m_SphereGeometries[object.index], packet.GetRay(i), hitRecords[i]))
+							packet.max[i] = hitRecords[i].t;
+					}
+					break;
+				case SceneObjectType::TriangleMesh:
+					GeometryUtils::HitTest_TriangleMeshPacket(m_TriangleMeshGeometries[object.index], packet, hitRecords);
+					break;
+				case SceneObjectType::TriangleMeshInstance:
+					GeometryUtils::HitTest_TriangleMeshInstancePacket(m_TriangleMeshInstances[object.index], packet, hitRecords);
+					break;
+				}
+			});
 	}
 
 	bool Scene::DoesHit(const Ray& ray) const
+	{
+		OccluderCache occluder{};
+		return DoesHit(ray, occluder);
+	}
+
+	bool Scene::DoesHit(const Ray& ray, OccluderCache& occluder) const
 	{
 		//todo W2
-		for (const Sphere& sphere : m_SphereGeometries)
+		if (IsOccludedBy(occluder, ray))
+			return true;
+
+		float t{};
+		const int planeIndex{ IntersectPlanes(m_PlaneSoA, ray, t, true) };
+		if (planeIndex >= 0)
 		{
-			if (GeometryUtils::HitTest_Sphere(sphere, ray))
-				return true;
+			occluder = { OccluderCache::Type::Plane, static_cast<uint32_t>(planeIndex) };
+			return true;
 		}
-		for (const Plane& plane : m_PlaneGeometries)
+
+		const int sphereIndex{ IntersectSpheres(m_SphereSoA, ray, t, true) };
+		if (sphereIndex >= 0)
+		{
+			occluder = { OccluderCache::Type::Sphere, static_cast<uint32_t>(sphereIndex) };
+			return true;
+		}
+
+		return GeometryUtils::TraverseWideBVH(m_SceneWideBVH, ray, true, [&](uint32_t objectIndex)
+			{
+				const SceneObjectRef& object{ m_SceneObjects[objectIndex] };
+				uint32_t triangleIndex{};
+				switch (object.type)
+				{
+				case SceneObjectType::Sphere:
+					if (!GeometryUtils::IsOccluded_Sphere(m_SphereGeometries[object.index], ray))
+						return false;
+					occluder = { OccluderCache::Type::Sphere, object.index };
+					return true;
+				case SceneObjectType::TriangleMesh:
+					if (!GeometryUtils::IsOccluded_TriangleMesh(m_TriangleMeshGeometries[object.index], ray, triangleIndex))
+						return false;
+					occluder = { OccluderCache::Type::TriangleMesh, object.index, triangleIndex };
+					return true;
+				case SceneObjectType::TriangleMeshInstance:
+					if (!GeometryUtils::IsOccluded_TriangleMeshInstance(m_TriangleMeshInstances[object.index], ray, triangleIndex))
+						return false;
+					occluder = { OccluderCache::Type::TriangleMeshInstance, object.index, triangleIndex };
+					return true;
+				}
+				return false;
+			});
+	}
+
+	bool Scene::IsOccludedBy(const OccluderCache& occluder, const Ray& ray) const
+	{
+		//The cache can outlive the geometry it points at (scene switch, removed objects), so every index is checked
+		switch (occluder.type)
+		{
+		case OccluderCache::Type::Plane:
+			return occluder.objectIndex < m_PlaneGeometries.size() &&
+				GeometryUtils::IsOccluded_Plane(m_PlaneGeometries[occluder.objectIndex], ray);
+		case OccluderCache::Type::Sphere:
+			return occluder.objectIndex < m_SphereGeometries.size() &&
+				GeometryUtils::IsOccluded_Sphere(m_SphereGeometries[occluder.objectIndex], ray);
+		case OccluderCache::Type::TriangleMesh:
 		{
-			if (GeometryUtils::HitTest_Plane(plane, ray))
-				return true;
+			if (occluder.objectIndex >= m_TriangleMeshGeometries.size())
+				return false;
+
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[occluder.objectIndex] };
+			if (occluder.primitiveIndex >= mesh.triangles.size())
+				return false;
+
+			const Ray localRay{ mesh.transformMode == TriangleMeshTransformMode::ObjectSpace ? GeometryUtils::TransformRayToObject(mesh.inverseTransform, ray) : ray };
+			return GeometryUtils::IsOccluded_Triangle(mesh.triangles[occluder.primitiveIndex], mesh.cullMode, localRay);
 		}
-		//for (const Triangle& Triangle : m_Triangles)
-		//{
-		//	if (GeometryUtils::HitTest_Triangle(Triangle, ray))
-		//		return true;
-		//}
-		for (const TriangleMesh& triangleMesh : m_TriangleMeshGeometries)
+		case OccluderCache::Type::TriangleMeshInstance:
 		{
-			if (GeometryUtils::HitTest_TriangleMesh(triangleMesh, ray))
-				return true;
+			if (occluder.objectIndex >= m_TriangleMeshInstances.size())
+				return false;
+
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[occluder.objectIndex] };
+			const std::vector<TriangleRecord>& triangles{ instance.pGeometry->triangles };
+			if (occluder.primitiveIndex >= triangles.size())
+				return false;
+
+			return GeometryUtils::IsOccluded_Triangle(triangles[occluder.primitiveIndex], instance.cullMode, GeometryUtils::TransformRayToObject(instance.inverseTransform, ray));
+		}
+		default:
+			return false;
 		}
-		//throw std::runtime_error("Not Implemented Yet");
-		return false;
 	}
 
 #pragma region Scene Helpers
@@ -109,6 +388,30 @@ namespace dae {
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	const MeshGeometry* Scene::AddMeshGeometry(const std::vector<Vector3>& positions, const std::vector<Vector3>& normals, const std::vector<int>& indices)
+	{
+		m_MeshGeometries.push_back(new MeshGeometry{ positions, normals, indices });
+		return m_MeshGeometries.back();
+	}
+
+	const MeshGeometry* Scene::AddMeshGeometry(const TriangleMesh& mesh)
+	{
+		m_MeshGeometries.push_back(new MeshGeometry{ mesh });
+		return m_MeshGeometries.back();
+	}
+
+	TriangleMeshInstance* Scene::AddTriangleMeshInstance(const MeshGeometry* pGeometry, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		TriangleMeshInstance instance{};
+		instance.pGeometry = pGeometry;
+		instance.cullMode = cullMode;
+		instance.materialIndex = materialIndex;
+		instance.UpdateTransforms();
+
+		m_TriangleMeshInstances.emplace_back(instance);
+		return &m_TriangleMeshInstances.back();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -312,7 +615,7 @@ namespace dae {
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f,-1.f }, matLambert_GrayBlue);//BACK
 
 		pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/simple_cube.obj", pMesh->positions, pMesh->normals, pMesh->indices);
+		Utils::ParseOBJ("Resources/simple_cube.obj", *pMesh);
 		pMesh->Scale({ .7f,.7f,.7f });
 		pMesh->Translate({ .0f,1.f,.0f });
 		pMesh->UpdateTransforms();
@@ -396,4 +699,46 @@ namespace dae {
 			m->UpdateTransforms();
 		}
 	}
+
+	void Scene_Instancing::Initialize()
+	{
+		sceneName = "Instancing Scene";
+		m_Camera.origin = { 0.f,7.f,-16.f };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matLambert_GrayBlue{ AddMaterial(new Material_Lambert({0.49f,0.57f,0.57f},1.f)) };
+		const auto matLambert_White{ AddMaterial(new Material_Lambert(colors::White,1.f)) };
+		const auto matCT_GrayMediumPlastic{ AddMaterial(new Material_CookTorrence({0.75f,0.75f,0.75f},0.f,0.6f)) };
+
+		//planes
+		AddPlane({ 0.f, 0.f, 0.f }, { 0.f, 1.f,0.f }, matLambert_GrayBlue);//BOTTOM
+		AddPlane({ 0.f, 0.f, 60.f }, { 0.f, 0.f,-1.f }, matLambert_GrayBlue);//BACK
+
+		//one copy of the bunny, placed a thousand times
+		TriangleMesh bunny{};
+		Utils::ParseOBJ("Resources/lowpoly_bunny.obj", bunny);
+		const MeshGeometry* pBunny{ AddMeshGeometry(bunny) };
+
+		constexpr int gridSize{ 10 };
+		m_TriangleMeshInstances.reserve(gridSize * gridSize * gridSize);
+		for (int x{}; x < gridSize; ++x)
+		{
+			for (int y{}; y < gridSize; ++y)
+			{
+				for (int z{}; z < gridSize; ++z)
+				{
+					auto pInstance{ AddTriangleMeshInstance(pBunny, TriangleCullMode::BackFaceCulling, (x + y + z) % 2 ? matLambert_White : matCT_GrayMediumPlastic) };
+					pInstance->Scale({ .8f, .8f, .8f });
+					pInstance->RotateY((x * 7 + y * 3 + z) * PI_DIV_4);
+					pInstance->Translate({ (x - gridSize / 2) * 1.5f, y * 1.5f, z * 1.5f });
+					pInstance->UpdateTransforms();
+				}
+			}
+		}
+
+		//Lights
+		AddPointLight(Vector3{ 0.0f,20.f,-5.f }, 500.f, ColorRGB{ 1.f,0.61f,0.45f });
+		AddPointLight(Vector3{ -2.5f,5.f,-5.f }, 70.f, ColorRGB{ 1.f,0.8f,0.45f });
+		AddDirectionalLight(Vector3{ 0.5f,-1.f,0.5f }.Normalized(), 1.f, colors::White);
+	}
 }
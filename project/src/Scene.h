@@ -4,6 +4,8 @@
 
 #include "Maths.h"
 #include "DataTypes.h"
+#include "MaterialBatch.h"
+#include "PrimitiveSoA.h"
 #include "Camera.h"
 
 namespace dae
@@ -15,6 +17,39 @@ namespace dae
 	struct Sphere;
 	struct Light;
 
+	//Finite geometry referenced by the leaves of the top-level scene BVH
+	enum class SceneObjectType : uint8_t
+	{
+		Sphere,
+		TriangleMesh,
+		TriangleMeshInstance
+	};
+
+	struct SceneObjectRef
+	{
+		SceneObjectType type{};
+		uint32_t index{};
+	};
+
+	//Last primitive that blocked a shadow ray, neighbouring shadow rays towards the same light usually hit it too
+	//Only a hint: it is tested first and replaced whenever another primitive turns out to block the ray
+	struct OccluderCache
+	{
+		enum class Type : uint8_t
+		{
+			None,
+			Plane,
+			Sphere,
+			TriangleMesh,
+			TriangleMeshInstance
+		};
+
+		Type type{ Type::None };
+		uint32_t objectIndex{};
+		//triangle index inside the mesh, unused for planes and spheres
+		uint32_t primitiveIndex{};
+	};
+
 	//Scene Base Class
 	class Scene
 	{
@@ -34,13 +69,27 @@ namespace dae
 		}
 
 		Camera& GetCamera() { return m_Camera; }
+
+		//Up to this many spheres are tested all at once from the SoA mirror, more than that go into the top-level BVH
+		static constexpr uint32_t MaxSoASpheres{ 64 };
+
+		//Refits (or rebuilds) the top-level BVH over the spheres and mesh bounds and refreshes the SoA mirrors, call after geometry was added or moved
+		void UpdateAccelerationStructure();
+		//Goes up whenever UpdateAccelerationStructure finds geometry, transforms or lights that differ from the previous call
+		uint64_t GetVersion() const { return m_Version; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		//Closest hit of every ray in the packet, hitRecords holds packet.size records
+		void GetClosestHits(RayPacket& packet, HitRecord* hitRecords) const;
 		bool DoesHit(const Ray& ray) const;
+		//Shadow ray test that tries the cached occluder first and stores whatever blocked the ray in it
+		bool DoesHit(const Ray& ray, OccluderCache& occluder) const;
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const std::vector<Material*>& GetMaterials() const { return m_Materials; }
+		//Flat copy of the materials the renderer shades with, refreshed by UpdateAccelerationStructure
+		const std::vector<MaterialData>& GetMaterialData() const { return m_MaterialData; }
 
 	protected:
 		std::string	sceneName;
@@ -48,8 +97,25 @@ namespace dae
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<MeshGeometry*> m_MeshGeometries{};
+		std::vector<TriangleMeshInstance> m_TriangleMeshInstances{};
 		std::vector<Light> m_Lights{};
 		std::vector<Material*> m_Materials{};
+		std::vector<MaterialData> m_MaterialData{};
+
+		//Top-level BVH over the finite geometry, planes are infinite and stay in their own list
+		BVH m_SceneBVH{};
+		WideBVH m_SceneWideBVH{};
+		std::vector<SceneObjectRef> m_SceneObjects{};
+		std::vector<AABB> m_SceneObjectBounds{};
+		SphereSoA m_SphereSoA{};
+		PlaneSoA m_PlaneSoA{};
+
+		bool IsOccludedBy(const OccluderCache& occluder, const Ray& ray) const;
+
+		uint64_t m_Version{};
+		uint64_t m_StateHash{};
+		uint64_t HashState() const;
 
 		//Temp (Individual Triangle Testing)
 		std::vector<Triangle> m_Triangles{};
@@ -59,6 +125,10 @@ namespace dae
 		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
 		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
 		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		//The scene owns the geometry, any number of instances can share it
+		const MeshGeometry* AddMeshGeometry(const std::vector<Vector3>& positions, const std::vector<Vector3>& normals, const std::vector<int>& indices);
+		const MeshGeometry* AddMeshGeometry(const TriangleMesh& mesh);
+		TriangleMeshInstance* AddTriangleMeshInstance(const MeshGeometry* pGeometry, TriangleCullMode cullMode, unsigned char materialIndex = 0);
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
@@ -156,4 +226,19 @@ namespace dae
 	private:
 		TriangleMesh* m_Meshes[3]{};
 	};
+
+	//Many placements of one bunny that all share a single MeshGeometry
+	class Scene_Instancing final : public Scene
+	{
+	public:
+		Scene_Instancing() = default;
+		~Scene_Instancing() override = default;
+
+		Scene_Instancing(const Scene_Instancing&) = delete;
+		Scene_Instancing(Scene_Instancing&&) noexcept = delete;
+		Scene_Instancing& operator=(const Scene_Instancing&) = delete;
+		Scene_Instancing& operator=(Scene_Instancing&&) noexcept = delete;
+
+		void Initialize() override;
+	};
 }
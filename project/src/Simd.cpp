@@ -0,0 +1,52 @@
+#include "Simd.h"
+
+#if defined(DAE_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dae
+{
+	static SimdLevel DetectSimdLevel()
+	{
+#if defined(DAE_X86)
+#if defined(_MSC_VER)
+		int info[4]{};
+		__cpuid(info, 0);
+		const int nrIds{ info[0] };
+		if (nrIds < 1)
+			return SimdLevel::Scalar;
+
+		__cpuid(info, 1);
+		const bool hasSSE41{ (info[2] & (1 << 19)) != 0 };
+		//AVX registers are only usable when the OS saves them on a context switch
+		const bool hasOSXSave{ (info[2] & (1 << 27)) != 0 };
+		const bool hasAVX{ (info[2] & (1 << 28)) != 0 };
+
+		bool hasAVX2{ false };
+		if (nrIds >= 7 && hasOSXSave && hasAVX && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			hasAVX2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		if (hasAVX2)
+			return SimdLevel::AVX2;
+		if (hasSSE41)
+			return SimdLevel::SSE41;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return SimdLevel::AVX2;
+		if (__builtin_cpu_supports("sse4.1"))
+			return SimdLevel::SSE41;
+#endif
+#endif
+		return SimdLevel::Scalar;
+	}
+
+	SimdLevel GetSupportedSimdLevel()
+	{
+		static const SimdLevel simdLevel{ DetectSimdLevel() };
+		return simdLevel;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+//DAE_SCALAR_MATH is the reference build: every SIMD kernel and the SIMD math compile out,
+//so results of the fast paths can be checked against plain scalar code
+#if !defined(DAE_SCALAR_MATH) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define DAE_X86
+#include <immintrin.h>
+#endif
+
+//SSE2 is part of x86-64, so header math can use it without a target attribute and still inline everywhere
+#if defined(DAE_X86) && (defined(__x86_64__) || defined(_M_X64))
+#define DAE_SSE2
+#endif
+
+//GCC and Clang only emit SSE4.1/AVX2 instructions in functions that ask for them, MSVC always allows them
+#if defined(__GNUC__) || defined(__clang__)
+#define DAE_TARGET(instructionSet) __attribute__((target(instructionSet)))
+#else
+#define DAE_TARGET(instructionSet)
+#endif
+
+namespace dae
+{
+	//Instruction sets the SIMD kernels can run with, detected once from CPUID
+	enum class SimdLevel
+	{
+		Scalar,
+		SSE41,
+		AVX2
+	};
+
+	SimdLevel GetSupportedSimdLevel();
+}
@@ -0,0 +1,198 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace dae
+{
+	static uint64_t PackRange(uint32_t begin, uint32_t end)
+	{
+		return static_cast<uint64_t>(end) << 32 | begin;
+	}
+
+	static void PinThread(std::thread& thread, int core)
+	{
+#if defined(_WIN32)
+		SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{ 1 } << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+		cpu_set_t cpuSet;
+		CPU_ZERO(&cpuSet);
+		CPU_SET(core % CPU_SETSIZE, &cpuSet);
+		pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet);
+#else
+		(void)thread;
+		(void)core;
+#endif
+	}
+
+	TileScheduler::~TileScheduler()
+	{
+		Stop();
+	}
+
+	void TileScheduler::Start(int nrThreads, bool pinThreads)
+	{
+		Stop();
+
+		const int nrHardwareThreads{ static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)) };
+		m_NrQueues = nrThreads > 0 ? nrThreads : nrHardwareThreads;
+		m_pQueues = std::make_unique<TileQueue[]>(m_NrQueues);
+
+		m_Workers.reserve(m_NrQueues - 1);
+		for (int i{ 1 }; i < m_NrQueues; ++i)
+		{
+			m_Workers.emplace_back(&TileScheduler::WorkerLoop, this, i);
+			if (pinThreads)
+				PinThread(m_Workers.back(), i % nrHardwareThreads);
+		}
+	}
+
+	void TileScheduler::Stop()
+	{
+		{
+			std::lock_guard lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_WorkAvailable.notify_all();
+
+		for (std::thread& worker : m_Workers)
+		{
+			worker.join();
+		}
+		m_Workers.clear();
+
+		m_pQueues.reset();
+		m_NrQueues = 0;
+		m_IsStopping = false;
+	}
+
+	void TileScheduler::RunTiles(uint32_t nrTiles, TaskFunction pTaskFunction, void* pTask)
+	{
+		if (m_NrQueues <= 1)
+		{
+			for (uint32_t i{}; i < nrTiles; ++i)
+			{
+				pTaskFunction(pTask, i);
+			}
+			return;
+		}
+
+		{
+			//A worker that woke up late for the previous frame may still be scanning the queues
+			std::unique_lock lock{ m_Mutex };
+			m_WorkDone.wait(lock, [this] { return m_NrActiveWorkers == 0; });
+
+			//Neighbouring tiles go to the same thread, so it keeps walking through the same part of the scene
+			for (int i{}; i < m_NrQueues; ++i)
+			{
+				const uint32_t begin{ static_cast<uint32_t>(uint64_t{ nrTiles } * i / m_NrQueues) };
+				const uint32_t end{ static_cast<uint32_t>(uint64_t{ nrTiles } * (i + 1) / m_NrQueues) };
+				m_pQueues[i].range.store(PackRange(begin, end), std::memory_order_relaxed);
+			}
+
+			m_pTaskFunction = pTaskFunction;
+			m_pTask = pTask;
+			++m_Generation;
+		}
+		m_WorkAvailable.notify_all();
+
+		ProcessTiles(0, pTaskFunction, pTask);
+
+		//Tiles stolen by the workers can still be running after the queues ran dry
+		std::unique_lock lock{ m_Mutex };
+		m_WorkDone.wait(lock, [this] { return m_NrActiveWorkers == 0; });
+	}
+
+	void TileScheduler::WorkerLoop(int queueIndex)
+	{
+		uint64_t seenGeneration{};
+		while (true)
+		{
+			TaskFunction pTaskFunction{};
+			void* pTask{};
+			{
+				std::unique_lock lock{ m_Mutex };
+				m_WorkAvailable.wait(lock, [&] { return m_IsStopping || m_Generation != seenGeneration; });
+				if (m_IsStopping)
+					return;
+
+				seenGeneration = m_Generation;
+				pTaskFunction = m_pTaskFunction;
+				pTask = m_pTask;
+				++m_NrActiveWorkers;
+			}
+
+			ProcessTiles(queueIndex, pTaskFunction, pTask);
+
+			bool isLastWorker{};
+			{
+				std::lock_guard lock{ m_Mutex };
+				isLastWorker = --m_NrActiveWorkers == 0;
+			}
+			if (isLastWorker)
+				m_WorkDone.notify_all();
+		}
+	}
+
+	void TileScheduler::ProcessTiles(int queueIndex, TaskFunction pTaskFunction, void* pTask)
+	{
+		uint32_t tileIndex{};
+		while (PopTile(m_pQueues[queueIndex], tileIndex) || StealTiles(queueIndex, tileIndex))
+		{
+			pTaskFunction(pTask, tileIndex);
+		}
+	}
+
+	bool TileScheduler::PopTile(TileQueue& queue, uint32_t& tileIndex)
+	{
+		uint64_t range{ queue.range.load(std::memory_order_relaxed) };
+		while (true)
+		{
+			const uint32_t begin{ static_cast<uint32_t>(range) };
+			const uint32_t end{ static_cast<uint32_t>(range >> 32) };
+			if (begin >= end)
+				return false;
+
+			if (queue.range.compare_exchange_weak(range, PackRange(begin + 1, end), std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				tileIndex = begin;
+				return true;
+			}
+		}
+	}
+
+	bool TileScheduler::StealTiles(int queueIndex, uint32_t& tileIndex)
+	{
+		for (int offset{ 1 }; offset < m_NrQueues; ++offset)
+		{
+			TileQueue& victim{ m_pQueues[(queueIndex + offset) % m_NrQueues] };
+			uint64_t range{ victim.range.load(std::memory_order_relaxed) };
+			while (true)
+			{
+				const uint32_t begin{ static_cast<uint32_t>(range) };
+				const uint32_t end{ static_cast<uint32_t>(range >> 32) };
+				if (begin >= end)
+					break;
+
+				//Taking the back half leaves the victim the tiles next to the one it is working on
+				const uint32_t stealBegin{ end - (end - begin + 1) / 2 };
+				if (!victim.range.compare_exchange_weak(range, PackRange(begin, stealBegin), std::memory_order_acquire, std::memory_order_relaxed))
+					continue;
+
+				//Our own queue is empty here, thieves only touch a queue that still has tiles
+				m_pQueues[queueIndex].range.store(PackRange(stealBegin + 1, end), std::memory_order_release);
+				tileIndex = stealBegin;
+				return true;
+			}
+		}
+		return false;
+	}
+}
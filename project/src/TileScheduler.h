@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	//Persistent worker threads that run the tiles of a frame
+	//Every worker owns a contiguous range of tile indices and takes tiles from its front,
+	//a worker that runs out steals the back half of another worker's range
+	class TileScheduler final
+	{
+	public:
+		TileScheduler() = default;
+		~TileScheduler();
+
+		TileScheduler(const TileScheduler&) = delete;
+		TileScheduler(TileScheduler&&) noexcept = delete;
+		TileScheduler& operator=(const TileScheduler&) = delete;
+		TileScheduler& operator=(TileScheduler&&) noexcept = delete;
+
+		//nrThreads counts the thread that calls Run, 0 uses every hardware thread
+		//pinThreads binds worker i to core i + 1, the calling thread is left alone
+		void Start(int nrThreads = 0, bool pinThreads = false);
+		void Stop();
+
+		int GetThreadCount() const { return m_NrQueues; }
+
+		//Calls task(tileIndex) once for every tile in [0, nrTiles) and returns when all of them are done
+		//The calling thread works along, without Start everything runs on it
+		template<typename Task>
+		void Run(uint32_t nrTiles, Task& task)
+		{
+			RunTiles(nrTiles, [](void* pTask, uint32_t tileIndex) { (*static_cast<Task*>(pTask))(tileIndex); }, &task);
+		}
+
+	private:
+		using TaskFunction = void(*)(void*, uint32_t);
+
+		//Remaining tile range of one worker, begin in the low and end in the high 32 bits
+		//so the owner and the thieves both update it with one compare-exchange
+		struct alignas(64) TileQueue
+		{
+			std::atomic<uint64_t> range{};
+		};
+
+		//One queue per thread, index 0 belongs to the thread that calls Run
+		std::unique_ptr<TileQueue[]> m_pQueues{};
+		int m_NrQueues{};
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::condition_variable m_WorkDone{};
+		uint64_t m_Generation{};
+		int m_NrActiveWorkers{};
+		bool m_IsStopping{ false };
+
+		TaskFunction m_pTaskFunction{ nullptr };
+		void* m_pTask{ nullptr };
+
+		void RunTiles(uint32_t nrTiles, TaskFunction pTaskFunction, void* pTask);
+		void WorkerLoop(int queueIndex);
+		void ProcessTiles(int queueIndex, TaskFunction pTaskFunction, void* pTask);
+		bool PopTile(TileQueue& queue, uint32_t& tileIndex);
+		bool StealTiles(int queueIndex, uint32_t& tileIndex);
+	};
+}
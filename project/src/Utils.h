@@ -1,7 +1,9 @@
 #pragma once
-#include <fstream>
+#include <bit>
 #include "Maths.h"
 #include "DataTypes.h"
+#include "MeshCache.h"
+#include "OBJLoader.h"
 
 namespace dae
 {
@@ -47,10 +49,26 @@ namespace dae
 			return false;
 		}
 
+		//Any-hit test, same roots and bounds as above without touching a hit record
+		inline bool IsOccluded_Sphere(const Sphere& sphere, const Ray& ray)
+		{
+			const Vector3 sphereToOrigin{ ray.origin - sphere.origin };
+			const float A{ Vector3::Dot(ray.direction, ray.direction) };
+			const float B{ Vector3::Dot((2 * ray.direction), sphereToOrigin) };
+			const float C{ Vector3::Dot(sphereToOrigin, sphereToOrigin) - Square(sphere.radius) };
+			const float D{ Square(B) - (4 * A * C) };
+			if (D <= 0)
+				return false;
+
+			float t{ (-B - sqrtf(D)) / (2 * A) };
+			if (t < ray.min)
+				t = (-B + sqrtf(D)) / (2 * A);
+			return t > ray.min && t < ray.max;
+		}
+
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Sphere(sphere, ray, temp, true);
+			return IsOccluded_Sphere(sphere, ray);
 		}
 #pragma endregion
 #pragma region Plane HitTest
@@ -77,143 +95,664 @@ namespace dae
 			return false;
 		}
 
+		inline bool IsOccluded_Plane(const Plane& plane, const Ray& ray)
+		{
+			const float t = Vector3::Dot((plane.origin - ray.origin), plane.normal) / Vector3::Dot(ray.direction, plane.normal);
+			return t > ray.min && t < ray.max;
+		}
+
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Plane(plane, ray, temp, true);
+			return IsOccluded_Plane(plane, ray);
 		}
 #pragma endregion
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
-		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		//Moller-Trumbore: solves for t and the barycentrics at once, without going through the plane hit point
+		//The normal has to follow the winding (cross(edge1, edge2) direction), the sign of the determinant decides the culling
+		inline bool HitTest_Triangle(const TriangleRecord& triangle, TriangleCullMode cullMode, unsigned char materialIndex, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
-			//todo W5
-			//the angle between the nromal of the triangle and the lightray
-			float angleRay{ Vector3::Dot(triangle.normal,ray.direction) };
-			TriangleCullMode cullingMode{ triangle.cullMode };
+			const Vector3 p{ Vector3::Cross(ray.direction, triangle.edge2) };
+			//-Dot(normal, direction) scaled by the triangle area: negative when the ray hits the back face
+			const float determinant{ Vector3::Dot(triangle.edge1, p) };
 
-			if (ignoreHitRecord)
+			switch (cullMode)
 			{
-				if (cullingMode == TriangleCullMode::BackFaceCulling)cullingMode = TriangleCullMode::FrontFaceCulling;
-				else if (cullingMode == TriangleCullMode::FrontFaceCulling)cullingMode = TriangleCullMode::BackFaceCulling;
-			}
-
-			switch (triangle.cullMode)
-			{	
-				//check if the cullmode is backface and if the angle 
 			case TriangleCullMode::BackFaceCulling:
-				if (angleRay > 0)
+				if (determinant < 0.f)
 					return false;
 				break;
 			case TriangleCullMode::FrontFaceCulling:
-				if (angleRay < 0)
-					return false;
-			case TriangleCullMode::NoCulling:
-				if (angleRay == 0)
+				if (determinant > 0.f)
 					return false;
+				break;
+			default:
+				break;
 			}
+			//ray parallel to the triangle
+			if (determinant == 0.f)
+				return false;
 
-				Vector3 planeOrigin{ (triangle.v0 + triangle.v1 + triangle.v2) / 3.f };
-				Vector3 L{ triangle.v0 - ray.origin };
-				float t{ Vector3::Dot(L,triangle.normal) / angleRay };
+			const float invDeterminant{ 1.f / determinant };
+			const Vector3 s{ ray.origin - triangle.v0 };
+			const float u{ Vector3::Dot(s, p) * invDeterminant };
+			if (u < 0.f || u > 1.f)
+				return false;
 
-				if (t < ray.min || t > ray.max)
-					return false;
+			const Vector3 q{ Vector3::Cross(s, triangle.edge1) };
+			const float v{ Vector3::Dot(ray.direction, q) * invDeterminant };
+			if (v < 0.f || u + v > 1.f)
+				return false;
 
-				Vector3 P{ ray.origin + ray.direction * t };
-				Vector3 e{ triangle.v1 - triangle.v0 };
-				Vector3 p{ P - triangle.v0 };
-				if (Vector3::Dot(Vector3::Cross(e, p), triangle.normal) < 0)
-					return false;
+			const float t{ Vector3::Dot(triangle.edge2, q) * invDeterminant };
+			if (t < ray.min || t > ray.max)
+				return false;
 
-				e = triangle.v2 - triangle.v1;
-				p = P - triangle.v1;
-				if (Vector3::Dot(Vector3::Cross(e, p), triangle.normal) < 0)
-					return false;
+			if (!ignoreHitRecord)
+			{
+				hitRecord.t = t;
+				hitRecord.u = u;
+				hitRecord.v = v;
+				hitRecord.origin = ray.origin + ray.direction * t;
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = materialIndex;
+				hitRecord.normal = triangle.normal;
+			}
+			return true;
+		}
 
-				e = triangle.v0 - triangle.v2;
-				p = P - triangle.v2;
-				if (Vector3::Dot(Vector3::Cross(e, p), triangle.normal) < 0)
-					return false;
+		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			const TriangleRecord record{ triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0, triangle.normal };
+			return HitTest_Triangle(record, triangle.cullMode, triangle.materialIndex, ray, hitRecord, ignoreHitRecord);
+		}
 
-				if (!ignoreHitRecord)
-				{
-					hitRecord.t = t;
-					hitRecord.origin = P;
-					hitRecord.didHit = true;
-					hitRecord.materialIndex = triangle.materialIndex;
-					hitRecord.normal = triangle.normal;
-				}
-				return true;
+		//Any-hit version of the test above: same culling and bounds, no barycentrics or hit record
+		inline bool IsOccluded_Triangle(const TriangleRecord& triangle, TriangleCullMode cullMode, const Ray& ray)
+		{
+			const Vector3 p{ Vector3::Cross(ray.direction, triangle.edge2) };
+			const float determinant{ Vector3::Dot(triangle.edge1, p) };
+
+			if ((cullMode == TriangleCullMode::BackFaceCulling && determinant < 0.f) ||
+				(cullMode == TriangleCullMode::FrontFaceCulling && determinant > 0.f) ||
+				determinant == 0.f)
+				return false;
+
+			const float invDeterminant{ 1.f / determinant };
+			const Vector3 s{ ray.origin - triangle.v0 };
+			const float u{ Vector3::Dot(s, p) * invDeterminant };
+			if (u < 0.f || u > 1.f)
+				return false;
+
+			const Vector3 q{ Vector3::Cross(s, triangle.edge1) };
+			const float v{ Vector3::Dot(ray.direction, q) * invDeterminant };
+			if (v < 0.f || u + v > 1.f)
+				return false;
+
+			const float t{ Vector3::Dot(triangle.edge2, q) * invDeterminant };
+			return t >= ray.min && t <= ray.max;
 		}
 
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_Triangle(triangle, ray, temp, true);
+			const TriangleRecord record{ triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0, triangle.normal };
+			return IsOccluded_Triangle(record, triangle.cullMode, ray);
 		}
 #pragma endregion
 #pragma region TriangeMesh HitTest
-		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		//Returns the distance along the ray where it enters the box through tEntry
+		inline bool SlabTest_AABB(const Vector3& minAABB, const Vector3& maxAABB, const Ray& ray, const Vector3& invDirection, float& tEntry)
 		{
-			float tx1{ (mesh.transformedMinAABB.x - ray.origin.x) / ray.direction.x };
-			float tx2{ (mesh.transformedMaxAABB.x - ray.origin.x) / ray.direction.x };
+			const float tx1{ (minAABB.x - ray.origin.x) * invDirection.x };
+			const float tx2{ (maxAABB.x - ray.origin.x) * invDirection.x };
 
 			float tmin = std::min(tx1, tx2);
 			float tmax = std::max(tx1, tx2);
 
-			float ty1{ (mesh.transformedMinAABB.y - ray.origin.y) / ray.direction.y };
-			float ty2{ (mesh.transformedMaxAABB.y - ray.origin.y) / ray.direction.y };
+			const float ty1{ (minAABB.y - ray.origin.y) * invDirection.y };
+			const float ty2{ (maxAABB.y - ray.origin.y) * invDirection.y };
 
-			tmin = std::min(tmin, std::min(ty1, ty2));
-			tmax = std::max(tmax, std::max(ty1, ty2));
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
 
-			float tz1{ (mesh.transformedMinAABB.z - ray.origin.z) / ray.direction.z };
-			float tz2{ (mesh.transformedMaxAABB.z - ray.origin.z) / ray.direction.z };
+			const float tz1{ (minAABB.z - ray.origin.z) * invDirection.z };
+			const float tz2{ (maxAABB.z - ray.origin.z) * invDirection.z };
 
-			tmin = std::min(tmin, std::min(tz1, tz2));
-			tmax = std::max(tmax, std::max(tz1, tz2));
-			return tmax > 0 && tmax >= tmin;
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
 
+			tEntry = tmin;
+			return tmax >= tmin && tmax > ray.min && tmin < ray.max;
 		}
-		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+
+		inline Vector3 GetInverseDirection(const Ray& ray)
+		{
+			return { 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+		}
+
+		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		{
+			float tEntry{};
+			return SlabTest_AABB(mesh.transformedMinAABB, mesh.transformedMaxAABB, ray, GetInverseDirection(ray), tEntry);
+		}
+
+		//Walks the BVH nearest child first, hitPrimitive(primitiveIndex) tests one primitive and returns whether it was hit
+		//Closest-hit callers shrink ray.max on every hit so nodes behind the closest hit get skipped
+		//With anyHit the traversal stops at the first primitive that reports a hit
+		template<typename PrimitiveHitTest>
+		bool TraverseBVH(const BVH& bvh, const Ray& ray, bool anyHit, PrimitiveHitTest&& hitPrimitive)
 		{
-			if (!SlabTest_TriangleMesh(mesh, ray))
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			if (nodes.empty())
+				return false;
+
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+			const Vector3 invDirection{ GetInverseDirection(ray) };
+
+			float tEntry{};
+			if (!SlabTest_AABB(nodes[0].minAABB, nodes[0].maxAABB, ray, invDirection, tEntry))
+				return false;
+
+			bool hit{ false };
+			uint32_t nodeStack[BVH::MaxDepth * 2];
+			float entryStack[BVH::MaxDepth * 2];
+			int stackSize{};
+			nodeStack[stackSize] = 0;
+			entryStack[stackSize++] = tEntry;
+
+			while (stackSize > 0)
 			{
+				--stackSize;
+				if (entryStack[stackSize] >= ray.max)
+					continue;
+
+				const BVHNode& node{ nodes[nodeStack[stackSize]] };
+				if (node.IsLeaf())
+				{
+					for (uint32_t i{}; i < node.primitiveCount; ++i)
+					{
+						if (!hitPrimitive(primitiveIndices[node.leftFirst + i]))
+							continue;
+						if (anyHit)
+							return true;
+						hit = true;
+					}
+					continue;
+				}
+
+				//Visit the nearest child first, the far one is only traversed when it can still hold a closer hit
+				float tLeft{}, tRight{};
+				const BVHNode& left{ nodes[node.leftFirst] };
+				const BVHNode& right{ nodes[node.leftFirst + 1] };
+				const bool hitLeft{ SlabTest_AABB(left.minAABB, left.maxAABB, ray, invDirection, tLeft) };
+				const bool hitRight{ SlabTest_AABB(right.minAABB, right.maxAABB, ray, invDirection, tRight) };
+
+				if (hitLeft && hitRight)
+				{
+					const bool leftIsNear{ tLeft <= tRight };
+					nodeStack[stackSize] = leftIsNear ? node.leftFirst + 1 : node.leftFirst;
+					entryStack[stackSize++] = leftIsNear ? tRight : tLeft;
+					nodeStack[stackSize] = leftIsNear ? node.leftFirst : node.leftFirst + 1;
+					entryStack[stackSize++] = leftIsNear ? tLeft : tRight;
+				}
+				else if (hitLeft)
+				{
+					nodeStack[stackSize] = node.leftFirst;
+					entryStack[stackSize++] = tLeft;
+				}
+				else if (hitRight)
+				{
+					nodeStack[stackSize] = node.leftFirst + 1;
+					entryStack[stackSize++] = tRight;
+				}
+			}
+
+			return hit;
+		}
+
+		template<int Width, uint32_t(*IntersectChildren)(const WideBVHNode<Width>&, const WideRay&, float*), typename PrimitiveHitTest>
+		bool TraverseWideBVHNodes(const std::vector<WideBVHNode<Width>>& nodes, const std::vector<uint32_t>& primitiveIndices,
+			const Ray& ray, bool anyHit, PrimitiveHitTest&& hitPrimitive)
+		{
+			if (nodes.empty())
 				return false;
+
+			WideRay wideRay{};
+			const Vector3 invDirection{ GetInverseDirection(ray) };
+			for (int axis{}; axis < 3; ++axis)
+			{
+				wideRay.origin[axis] = ray.origin[axis];
+				wideRay.invDirection[axis] = invDirection[axis];
+				//the min planes come first in a node (x, y, z), followed by the max planes
+				const bool isPositive{ invDirection[axis] >= 0.f };
+				wideRay.nearOffset[axis] = (isPositive ? axis : axis + 3) * Width;
+				wideRay.farOffset[axis] = (isPositive ? axis + 3 : axis) * Width;
 			}
-			Triangle triangle{};
-			triangle.cullMode = mesh.cullMode;
-			triangle.materialIndex = mesh.materialIndex;
-			bool hit{ false };
-			HitRecord tempHitRecord;
+			wideRay.min = ray.min;
+
+			//Leaves go on the stack too, so primitives are tested in the same near to far order as nodes
+			struct StackEntry
+			{
+				uint32_t child;
+				uint32_t primitiveCount;
+				float tEntry;
+			};
+			StackEntry stack[WideBVH::StackSize];
+			int stackSize{};
+			stack[stackSize++] = { 0, 0, ray.min };
 
-			for (int i{}; i < mesh.indices.size(); i+=3)
+			bool hit{ false };
+			while (stackSize > 0)
 			{
-				triangle.v0 = mesh.transformedPositions[mesh.indices[i]];
-				triangle.v1 = mesh.transformedPositions[mesh.indices[i+1]];
-				triangle.v2 = mesh.transformedPositions[mesh.indices[i+2]];
-				//only need one normal per triangle
-				triangle.normal = mesh.transformedNormals[i / 3];
-				if(!HitTest_Triangle(triangle, ray, tempHitRecord, ignoreHitRecord))
+				const StackEntry entry{ stack[--stackSize] };
+				if (entry.tEntry >= ray.max)
+					continue;
+
+				if (entry.primitiveCount > 0)
+				{
+					for (uint32_t i{}; i < entry.primitiveCount; ++i)
+					{
+						if (!hitPrimitive(primitiveIndices[entry.child + i]))
+							continue;
+						if (anyHit)
+							return true;
+						hit = true;
+					}
 					continue;
-				if (ignoreHitRecord)
+				}
+
+				const WideBVHNode<Width>& node{ nodes[entry.child] };
+				wideRay.max = ray.max;
+				float tEntries[Width];
+				uint32_t hitMask{ IntersectChildren(node, wideRay, tEntries) };
+
+				//Sort the hit children far to near, then push them in that order so the nearest is popped first
+				//Any hit will do for occlusion, so those rays skip the sort
+				StackEntry hitChildren[Width];
+				int nrHitChildren{};
+				while (hitMask != 0)
+				{
+					const int i{ std::countr_zero(hitMask) };
+					hitMask &= hitMask - 1;
+
+					const StackEntry child{ node.child[i], node.primitiveCount[i], tEntries[i] };
+					if (anyHit)
+					{
+						hitChildren[nrHitChildren++] = child;
+						continue;
+					}
+
+					int insertAt{ nrHitChildren++ };
+					while (insertAt > 0 && hitChildren[insertAt - 1].tEntry < child.tEntry)
+					{
+						hitChildren[insertAt] = hitChildren[insertAt - 1];
+						--insertAt;
+					}
+					hitChildren[insertAt] = child;
+				}
+
+				for (int i{}; i < nrHitChildren; ++i)
+				{
+					stack[stackSize++] = hitChildren[i];
+				}
+			}
+
+			return hit;
+		}
+
+		//Same contract as TraverseBVH, the children of a node are tested with one SIMD sequence picked at build time
+		template<typename PrimitiveHitTest>
+		bool TraverseWideBVH(const WideBVH& wideBVH, const Ray& ray, bool anyHit, PrimitiveHitTest&& hitPrimitive)
+		{
+			switch (wideBVH.GetSimdLevel())
+			{
+			case SimdLevel::AVX2:
+				return TraverseWideBVHNodes<8, IntersectChildren_AVX2>(wideBVH.GetNodes8(), wideBVH.GetPrimitiveIndices(), ray, anyHit, hitPrimitive);
+			case SimdLevel::SSE41:
+				return TraverseWideBVHNodes<4, IntersectChildren_SSE41>(wideBVH.GetNodes4(), wideBVH.GetPrimitiveIndices(), ray, anyHit, hitPrimitive);
+			default:
+				return TraverseWideBVHNodes<4, IntersectChildren_Scalar>(wideBVH.GetNodes4(), wideBVH.GetPrimitiveIndices(), ray, anyHit, hitPrimitive);
+			}
+		}
+
+		//Normals go through the inverse transpose so they stay perpendicular under non-uniform scaling
+		inline Vector3 TransformNormalToWorld(const Matrix& inverseTransform, const Vector3& normal)
+		{
+			return {
+				Vector3::Dot(normal, inverseTransform[0]),
+				Vector3::Dot(normal, inverseTransform[1]),
+				Vector3::Dot(normal, inverseTransform[2]) };
+		}
+
+		//Traverses the triangles of one mesh in the space they were recorded in
+		//localRay.max is shrunk to the closest hit, hitRecord gets the hit in that same space
+		inline bool HitTest_MeshTriangles(const WideBVH& wideBVH, const std::vector<TriangleRecord>& triangles,
+			TriangleCullMode cullMode, unsigned char materialIndex, Ray& localRay, HitRecord& hitRecord, bool ignoreHitRecord)
+		{
+			return TraverseWideBVH(wideBVH, localRay, ignoreHitRecord, [&](uint32_t triangleIndex)
+				{
+					//Only writes the hit record when the triangle is closer than localRay.max
+					if (!HitTest_Triangle(triangles[triangleIndex], cullMode, materialIndex, localRay, hitRecord, ignoreHitRecord))
+						return false;
+
+					if (!ignoreHitRecord)
+						localRay.max = hitRecord.t;
 					return true;
-				if (hitRecord.t > tempHitRecord.t)
-					hitRecord = tempHitRecord;
-				hit = true;
+				});
+		}
+
+		//The direction is not renormalized, so t along the object space ray is the same t along the world ray
+		inline Ray TransformRayToObject(const Matrix& inverseTransform, const Ray& ray)
+		{
+			return { inverseTransform.TransformPoint(ray.origin), inverseTransform.TransformVector(ray.direction), ray.min, ray.max };
+		}
+
+		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			const bool isObjectSpace{ mesh.transformMode == TriangleMeshTransformMode::ObjectSpace };
+			Ray localRay{ isObjectSpace ? TransformRayToObject(mesh.inverseTransform, ray) : ray };
+
+			//Shrinking the ray to the closest hit so far lets the traversal skip every node behind it
+			if (!ignoreHitRecord)
+				localRay.max = std::min(ray.max, hitRecord.t);
+
+			const bool hit{ HitTest_MeshTriangles(mesh.wideBVH, mesh.triangles, mesh.cullMode, mesh.materialIndex, localRay, hitRecord, ignoreHitRecord) };
+
+			if (hit && isObjectSpace && !ignoreHitRecord)
+			{
+				hitRecord.origin = ray.origin + ray.direction * hitRecord.t;
+				hitRecord.normal = TransformNormalToWorld(mesh.inverseTransform, hitRecord.normal);
+			}
+			return hit;
+		}
+
+
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			const MeshGeometry& geometry{ *instance.pGeometry };
+			Ray localRay{ TransformRayToObject(instance.inverseTransform, ray) };
+			if (!ignoreHitRecord)
+				localRay.max = std::min(ray.max, hitRecord.t);
+
+			const bool hit{ HitTest_MeshTriangles(geometry.wideBVH, geometry.triangles, instance.cullMode, instance.materialIndex, localRay, hitRecord, ignoreHitRecord) };
+
+			if (hit && !ignoreHitRecord)
+			{
+				hitRecord.origin = ray.origin + ray.direction * hitRecord.t;
+				hitRecord.normal = TransformNormalToWorld(instance.inverseTransform, hitRecord.normal);
 			}
-			
 			return hit;
 		}
 
+#pragma endregion
+#pragma region Occlusion
+		//Any-hit traversal for shadow rays: no hit record, children in whatever order the box test returns them
+		//occluderIndex gets the triangle that blocked the ray, so the caller can test it first next time
+		inline bool IsOccluded_MeshTriangles(const WideBVH& wideBVH, const std::vector<TriangleRecord>& triangles,
+			TriangleCullMode cullMode, const Ray& localRay, uint32_t& occluderIndex)
+		{
+			return TraverseWideBVH(wideBVH, localRay, true, [&](uint32_t triangleIndex)
+				{
+					if (!IsOccluded_Triangle(triangles[triangleIndex], cullMode, localRay))
+						return false;
+
+					occluderIndex = triangleIndex;
+					return true;
+				});
+		}
+
+		inline bool IsOccluded_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, uint32_t& occluderIndex)
+		{
+			const Ray localRay{ mesh.transformMode == TriangleMeshTransformMode::ObjectSpace ? TransformRayToObject(mesh.inverseTransform, ray) : ray };
+			return IsOccluded_MeshTriangles(mesh.wideBVH, mesh.triangles, mesh.cullMode, localRay, occluderIndex);
+		}
+
+		inline bool IsOccluded_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray, uint32_t& occluderIndex)
+		{
+			const MeshGeometry& geometry{ *instance.pGeometry };
+			return IsOccluded_MeshTriangles(geometry.wideBVH, geometry.triangles, instance.cullMode, TransformRayToObject(instance.inverseTransform, ray), occluderIndex);
+		}
+
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
 		{
-			HitRecord temp{};
-			return HitTest_TriangleMesh(mesh, ray, temp, true);
+			uint32_t occluderIndex{};
+			return IsOccluded_TriangleMesh(mesh, ray, occluderIndex);
+		}
+
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const Ray& ray)
+		{
+			uint32_t occluderIndex{};
+			return IsOccluded_TriangleMeshInstance(instance, ray, occluderIndex);
 		}
 #pragma endregion
+#pragma region Packet HitTest
+		//Interval arithmetic bounds of the packet's inverse directions, used to cull nodes for the whole packet at once
+		//An axis where the rays point both ways (or lie in a plane) cannot cull and is skipped
+		struct RayPacketInterval
+		{
+			float invDirectionMin[3];
+			float invDirectionMax[3];
+			bool isUniform[3];
+		};
+
+		inline RayPacketInterval GetPacketInterval(const RayPacket& packet)
+		{
+			RayPacketInterval interval{};
+			const float* directions[3]{ packet.directionX, packet.directionY, packet.directionZ };
+			for (int axis{}; axis < 3; ++axis)
+			{
+				float directionMin{ FLT_MAX };
+				float directionMax{ -FLT_MAX };
+				for (int i{}; i < packet.size; ++i)
+				{
+					directionMin = std::min(directionMin, directions[axis][i]);
+					directionMax = std::max(directionMax, directions[axis][i]);
+				}
+
+				interval.isUniform[axis] = directionMin > 0.f || directionMax < 0.f;
+				//1/d shrinks as d grows on either side of zero
+				interval.invDirectionMin[axis] = 1.f / directionMax;
+				interval.invDirectionMax[axis] = 1.f / directionMin;
+			}
+			return interval;
+		}
+
+		//Conservative: false means no ray of the packet can hit the box before packetMax
+		//tEntry is a lower bound for the entry distance of every ray
+		inline bool SlabTest_Packet(const Vector3& minAABB, const Vector3& maxAABB, const RayPacket& packet, const RayPacketInterval& interval, float packetMax, float& tEntry)
+		{
+			float tNear{ packet.min };
+			float tFar{ packetMax };
+			for (int axis{}; axis < 3; ++axis)
+			{
+				if (!interval.isUniform[axis])
+					continue;
+
+				const bool isPositive{ interval.invDirectionMin[axis] > 0.f };
+				const float nearDistance{ (isPositive ? minAABB[axis] : maxAABB[axis]) - packet.origin[axis] };
+				const float farDistance{ (isPositive ? maxAABB[axis] : minAABB[axis]) - packet.origin[axis] };
+
+				tNear = std::max(tNear, std::min(nearDistance * interval.invDirectionMin[axis], nearDistance * interval.invDirectionMax[axis]));
+				tFar = std::min(tFar, std::max(farDistance * interval.invDirectionMin[axis], farDistance * interval.invDirectionMax[axis]));
+			}
+
+			tEntry = tNear;
+			return tNear <= tFar;
+		}
+
+		inline float GetPacketMax(const RayPacket& packet)
+		{
+			float packetMax{ -FLT_MAX };
+			for (int i{}; i < packet.size; ++i)
+			{
+				packetMax = std::max(packetMax, packet.max[i]);
+			}
+			return packetMax;
+		}
+
+		//Walks the binary BVH once for the whole packet, nearest child first
+		//hitPrimitive(primitiveIndex) tests every ray of the packet and shrinks packet.max for the rays it hits
+		template<typename PrimitiveHitTest>
+		void TraverseBVHPacket(const BVH& bvh, const RayPacket& packet, PrimitiveHitTest&& hitPrimitive)
+		{
+			const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+			if (nodes.empty())
+				return;
+
+			const std::vector<uint32_t>& primitiveIndices{ bvh.GetPrimitiveIndices() };
+			const RayPacketInterval interval{ GetPacketInterval(packet) };
+
+			float packetMax{ GetPacketMax(packet) };
+			float tEntry{};
+			if (!SlabTest_Packet(nodes[0].minAABB, nodes[0].maxAABB, packet, interval, packetMax, tEntry))
+				return;
+
+			uint32_t nodeStack[BVH::MaxDepth * 2];
+			float entryStack[BVH::MaxDepth * 2];
+			int stackSize{};
+			nodeStack[stackSize] = 0;
+			entryStack[stackSize++] = tEntry;
+
+			while (stackSize > 0)
+			{
+				--stackSize;
+				if (entryStack[stackSize] >= packetMax)
+					continue;
+
+				const BVHNode& node{ nodes[nodeStack[stackSize]] };
+				if (node.IsLeaf())
+				{
+					for (uint32_t i{}; i < node.primitiveCount; ++i)
+					{
+						hitPrimitive(primitiveIndices[node.leftFirst + i]);
+					}
+					packetMax = GetPacketMax(packet);
+					continue;
+				}
+
+				float tLeft{}, tRight{};
+				const BVHNode& left{ nodes[node.leftFirst] };
+				const BVHNode& right{ nodes[node.leftFirst + 1] };
+				const bool hitLeft{ SlabTest_Packet(left.minAABB, left.maxAABB, packet, interval, packetMax, tLeft) };
+				const bool hitRight{ SlabTest_Packet(right.minAABB, right.maxAABB, packet, interval, packetMax, tRight) };
+
+				if (hitLeft && hitRight)
+				{
+					const bool leftIsNear{ tLeft <= tRight };
+					nodeStack[stackSize] = leftIsNear ? node.leftFirst + 1 : node.leftFirst;
+					entryStack[stackSize++] = leftIsNear ? tRight : tLeft;
+					nodeStack[stackSize] = leftIsNear ? node.leftFirst : node.leftFirst + 1;
+					entryStack[stackSize++] = leftIsNear ? tLeft : tRight;
+				}
+				else if (hitLeft)
+				{
+					nodeStack[stackSize] = node.leftFirst;
+					entryStack[stackSize++] = tLeft;
+				}
+				else if (hitRight)
+				{
+					nodeStack[stackSize] = node.leftFirst + 1;
+					entryStack[stackSize++] = tRight;
+				}
+			}
+		}
+
+		//Same Moller-Trumbore math as HitTest_Triangle for every ray at once, without branches so the loop vectorizes
+		//The origin is shared, so everything that only depends on it and the triangle is computed once
+		inline void HitTest_TrianglePacket(const TriangleRecord& triangle, uint32_t triangleIndex, TriangleCullMode cullMode, RayPacket& packet,
+			int* hitTriangles, float* hitU, float* hitV)
+		{
+			const Vector3 s{ packet.origin - triangle.v0 };
+			const Vector3 q{ Vector3::Cross(s, triangle.edge1) };
+			const float tNumerator{ Vector3::Dot(triangle.edge2, q) };
+			const Vector3& e1{ triangle.edge1 };
+			const Vector3& e2{ triangle.edge2 };
+
+			for (int i{}; i < packet.size; ++i)
+			{
+				const float px{ packet.directionY[i] * e2.z - packet.directionZ[i] * e2.y };
+				const float py{ packet.directionZ[i] * e2.x - packet.directionX[i] * e2.z };
+				const float pz{ packet.directionX[i] * e2.y - packet.directionY[i] * e2.x };
+				const float determinant{ e1.x * px + e1.y * py + e1.z * pz };
+
+				const bool isCulled{
+					(cullMode == TriangleCullMode::BackFaceCulling && determinant < 0.f) ||
+					(cullMode == TriangleCullMode::FrontFaceCulling && determinant > 0.f) ||
+					determinant == 0.f };
+
+				const float invDeterminant{ 1.f / determinant };
+				const float u{ (s.x * px + s.y * py + s.z * pz) * invDeterminant };
+				const float v{ (packet.directionX[i] * q.x + packet.directionY[i] * q.y + packet.directionZ[i] * q.z) * invDeterminant };
+				const float t{ tNumerator * invDeterminant };
+
+				const bool isHit{ !isCulled && u >= 0.f && u <= 1.f && v >= 0.f && u + v <= 1.f && t >= packet.min && t <= packet.max[i] };
+				packet.max[i] = isHit ? t : packet.max[i];
+				hitTriangles[i] = isHit ? static_cast<int>(triangleIndex) : hitTriangles[i];
+				hitU[i] = isHit ? u : hitU[i];
+				hitV[i] = isHit ? v : hitV[i];
+			}
+		}
+
+		//Closest hits of a packet against one mesh, hitRecords has one record per ray
+		//For object space meshes the packet is moved into object space, t stays the same because directions are not renormalized
+		inline void HitTest_MeshTrianglesPacket(const BVH& bvh, const std::vector<TriangleRecord>& triangles, TriangleCullMode cullMode, unsigned char materialIndex,
+			const Matrix* pInverseTransform, RayPacket& packet, HitRecord* hitRecords)
+		{
+			RayPacket localPacket{ packet };
+			if (pInverseTransform)
+			{
+				localPacket.origin = pInverseTransform->TransformPoint(packet.origin);
+				for (int i{}; i < packet.size; ++i)
+				{
+					const Vector3 direction{ pInverseTransform->TransformVector(packet.GetDirection(i)) };
+					localPacket.directionX[i] = direction.x;
+					localPacket.directionY[i] = direction.y;
+					localPacket.directionZ[i] = direction.z;
+				}
+			}
+
+			int hitTriangles[RayPacket::MaxSize];
+			float hitU[RayPacket::MaxSize];
+			float hitV[RayPacket::MaxSize];
+			std::fill_n(hitTriangles, packet.size, -1);
+
+			TraverseBVHPacket(bvh, localPacket, [&](uint32_t triangleIndex)
+				{
+					HitTest_TrianglePacket(triangles[triangleIndex], triangleIndex, cullMode, localPacket, hitTriangles, hitU, hitV);
+				});
+
+			for (int i{}; i < packet.size; ++i)
+			{
+				if (hitTriangles[i] < 0)
+					continue;
+
+				const Vector3& normal{ triangles[hitTriangles[i]].normal };
+				HitRecord& hitRecord{ hitRecords[i] };
+				hitRecord.t = localPacket.max[i];
+				hitRecord.u = hitU[i];
+				hitRecord.v = hitV[i];
+				hitRecord.origin = packet.origin + packet.GetDirection(i) * hitRecord.t;
+				hitRecord.didHit = true;
+				hitRecord.materialIndex = materialIndex;
+				hitRecord.normal = pInverseTransform ? TransformNormalToWorld(*pInverseTransform, normal) : normal;
+				packet.max[i] = hitRecord.t;
+			}
+		}
 
+		inline void HitTest_TriangleMeshPacket(const TriangleMesh& mesh, RayPacket& packet, HitRecord* hitRecords)
+		{
+			const bool isObjectSpace{ mesh.transformMode == TriangleMeshTransformMode::ObjectSpace };
+			HitTest_MeshTrianglesPacket(mesh.bvh, mesh.triangles, mesh.cullMode, mesh.materialIndex,
+				isObjectSpace ? &mesh.inverseTransform : nullptr, packet, hitRecords);
+		}
+
+		inline void HitTest_TriangleMeshInstancePacket(const TriangleMeshInstance& instance, RayPacket& packet, HitRecord* hitRecords)
+		{
+			const MeshGeometry& geometry{ *instance.pGeometry };
+			HitTest_MeshTrianglesPacket(geometry.bvh, geometry.triangles, instance.cullMode, instance.materialIndex,
+				&instance.inverseTransform, packet, hitRecords);
+		}
+#pragma endregion
 	}
 
 	namespace LightUtils
@@ -253,75 +792,19 @@ namespace dae
 
 	namespace Utils
 	{
-		//Just parses vertices and indices
+		//Just parses vertices and indices, see LoadOBJ
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
 		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
 		{
-			std::ifstream file(filename);
-			if (!file)
-				return false;
-
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
-			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
-				}
-				else if (sCommand == "f")
-				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
-
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
-				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
-
-				if (file.eof())
-					break;
-			}
-
-			//Precompute normals
-			for (uint64_t index = 0; index < indices.size(); index += 3)
-			{
-				uint32_t i0 = indices[index];
-				uint32_t i1 = indices[index + 1];
-				uint32_t i2 = indices[index + 2];
-
-				Vector3 edgeV0V1 = positions[i1] - positions[i0];
-				Vector3 edgeV0V2 = positions[i2] - positions[i0];
-				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
-
-				if (std::isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normal.Normalize();
-				if (std::isnan(normal.x))
-				{
-					int k = 0;
-				}
-
-				normals.push_back(normal);
-			}
+			return LoadOBJ(filename, positions, normals, indices);
+		}
 
-			return true;
+		//Fills the mesh's vertices, indices, triangle normals and, when the file has them, its vertex normals and uvs
+		//Goes through the binary cache next to the OBJ and builds the BVH, see LoadCachedOBJ
+		static bool ParseOBJ(const std::string& filename, TriangleMesh& mesh)
+		{
+			return LoadCachedOBJ(filename, mesh);
 		}
 #pragma warning(pop)
 	}
@@ -0,0 +1,232 @@
+#include "WideBVH.h"
+
+#include <algorithm>
+
+namespace dae
+{
+	uint32_t IntersectChildren_Scalar(const WideBVHNode<4>& node, const WideRay& ray, float* tEntries)
+	{
+		//The intervals start as the ray interval, so a box behind the origin or past ray.max ends up empty
+		const float* planes{ reinterpret_cast<const float*>(&node) };
+
+		uint32_t hitMask{};
+		for (int i{}; i < 4; ++i)
+		{
+			float tNear{ ray.min };
+			float tFar{ ray.max };
+			for (int axis{}; axis < 3; ++axis)
+			{
+				tNear = std::max(tNear, (planes[ray.nearOffset[axis] + i] - ray.origin[axis]) * ray.invDirection[axis]);
+				tFar = std::min(tFar, (planes[ray.farOffset[axis] + i] - ray.origin[axis]) * ray.invDirection[axis]);
+			}
+
+			tEntries[i] = tNear;
+			if (tNear <= tFar)
+				hitMask |= 1u << i;
+		}
+		return hitMask;
+	}
+
+#if defined(DAE_X86)
+	DAE_TARGET("sse4.1")
+	uint32_t IntersectChildren_SSE41(const WideBVHNode<4>& node, const WideRay& ray, float* tEntries)
+	{
+		const float* planes{ reinterpret_cast<const float*>(&node) };
+
+		__m128 tNear{ _mm_set1_ps(ray.min) };
+		__m128 tFar{ _mm_set1_ps(ray.max) };
+		for (int axis{}; axis < 3; ++axis)
+		{
+			const __m128 origin{ _mm_set1_ps(ray.origin[axis]) };
+			const __m128 invDirection{ _mm_set1_ps(ray.invDirection[axis]) };
+			tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + ray.nearOffset[axis]), origin), invDirection), tNear);
+			tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(planes + ray.farOffset[axis]), origin), invDirection), tFar);
+		}
+
+		_mm_storeu_ps(tEntries, tNear);
+		return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)));
+	}
+
+	DAE_TARGET("avx2")
+	uint32_t IntersectChildren_AVX2(const WideBVHNode<8>& node, const WideRay& ray, float* tEntries)
+	{
+		const float* planes{ reinterpret_cast<const float*>(&node) };
+
+		__m256 tNear{ _mm256_set1_ps(ray.min) };
+		__m256 tFar{ _mm256_set1_ps(ray.max) };
+		for (int axis{}; axis < 3; ++axis)
+		{
+			const __m256 origin{ _mm256_set1_ps(ray.origin[axis]) };
+			const __m256 invDirection{ _mm256_set1_ps(ray.invDirection[axis]) };
+			tNear = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(planes + ray.nearOffset[axis]), origin), invDirection), tNear);
+			tFar = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(planes + ray.farOffset[axis]), origin), invDirection), tFar);
+		}
+
+		_mm256_storeu_ps(tEntries, tNear);
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+	}
+#else
+	//Never selected on other architectures, GetSupportedSimdLevel always reports Scalar there
+	uint32_t IntersectChildren_SSE41(const WideBVHNode<4>& node, const WideRay& ray, float* tEntries)
+	{
+		return IntersectChildren_Scalar(node, ray, tEntries);
+	}
+
+	uint32_t IntersectChildren_AVX2(const WideBVHNode<8>&, const WideRay&, float*)
+	{
+		return 0;
+	}
+#endif
+
+	void WideBVH::Build(const BVH& bvh)
+	{
+		Build(bvh, GetSupportedSimdLevel());
+	}
+
+	void WideBVH::Build(const BVH& bvh, SimdLevel simdLevel)
+	{
+		Clear();
+		if (bvh.IsEmpty())
+			return;
+
+		m_SimdLevel = std::min(simdLevel, GetSupportedSimdLevel());
+		m_PrimitiveIndices = bvh.GetPrimitiveIndices();
+		m_TopologyVersion = bvh.GetTopologyVersion();
+
+		if (m_SimdLevel == SimdLevel::AVX2)
+			Collapse(bvh, m_Nodes8);
+		else
+			Collapse(bvh, m_Nodes4);
+	}
+
+	void WideBVH::Update(const BVH& bvh)
+	{
+		if (IsEmpty() || bvh.IsEmpty() || bvh.GetTopologyVersion() != m_TopologyVersion)
+		{
+			Build(bvh, IsEmpty() ? GetSupportedSimdLevel() : m_SimdLevel);
+			return;
+		}
+
+		if (m_SimdLevel == SimdLevel::AVX2)
+			Refit(bvh, m_Nodes8);
+		else
+			Refit(bvh, m_Nodes4);
+	}
+
+	void WideBVH::Clear()
+	{
+		m_Nodes4.clear();
+		m_Nodes8.clear();
+		m_PrimitiveIndices.clear();
+		m_SlotNodes.clear();
+		m_TopologyVersion = 0;
+	}
+
+	template<int Width>
+	void WideBVH::Collapse(const BVH& bvh, std::vector<WideBVHNode<Width>>& wideNodes)
+	{
+		const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+
+		struct CollapseTask
+		{
+			uint32_t binaryIndex;
+			uint32_t wideIndex;
+		};
+		std::vector<CollapseTask> tasks{ { 0, 0 } };
+		wideNodes.emplace_back();
+		m_SlotNodes.resize(Width, InvalidNode);
+
+		while (!tasks.empty())
+		{
+			const CollapseTask task{ tasks.back() };
+			tasks.pop_back();
+
+			//Keep opening the interior child with the largest area until all slots are used
+			uint32_t children[Width]{ task.binaryIndex };
+			int nrChildren{ 1 };
+			while (nrChildren < Width)
+			{
+				int largestChild{ -1 };
+				float largestArea{ -1.f };
+				for (int i{}; i < nrChildren; ++i)
+				{
+					const BVHNode& child{ nodes[children[i]] };
+					if (child.IsLeaf())
+						continue;
+
+					const float area{ AABB{ child.minAABB, child.maxAABB }.Area() };
+					if (area > largestArea)
+					{
+						largestArea = area;
+						largestChild = i;
+					}
+				}
+				if (largestChild < 0)
+					break;
+
+				const uint32_t leftIndex{ nodes[children[largestChild]].leftFirst };
+				children[largestChild] = leftIndex;
+				children[nrChildren++] = leftIndex + 1;
+			}
+
+			for (int i{}; i < Width; ++i)
+			{
+				if (i >= nrChildren)
+				{
+					WideBVHNode<Width>& wideNode{ wideNodes[task.wideIndex] };
+					wideNode.minX[i] = wideNode.minY[i] = wideNode.minZ[i] = FLT_MAX;
+					wideNode.maxX[i] = wideNode.maxY[i] = wideNode.maxZ[i] = -FLT_MAX;
+					wideNode.child[i] = 0;
+					wideNode.primitiveCount[i] = 0;
+					continue;
+				}
+
+				const BVHNode& child{ nodes[children[i]] };
+				uint32_t childIndex{ child.leftFirst };
+				if (!child.IsLeaf())
+				{
+					//emplace_back may reallocate, so the parent is only looked up after it
+					childIndex = static_cast<uint32_t>(wideNodes.size());
+					wideNodes.emplace_back();
+					m_SlotNodes.resize(m_SlotNodes.size() + Width, InvalidNode);
+					tasks.push_back({ children[i], childIndex });
+				}
+				m_SlotNodes[task.wideIndex * Width + i] = children[i];
+
+				WideBVHNode<Width>& wideNode{ wideNodes[task.wideIndex] };
+				wideNode.minX[i] = child.minAABB.x;
+				wideNode.minY[i] = child.minAABB.y;
+				wideNode.minZ[i] = child.minAABB.z;
+				wideNode.maxX[i] = child.maxAABB.x;
+				wideNode.maxY[i] = child.maxAABB.y;
+				wideNode.maxZ[i] = child.maxAABB.z;
+				wideNode.child[i] = childIndex;
+				wideNode.primitiveCount[i] = child.primitiveCount;
+			}
+		}
+	}
+
+	template<int Width>
+	void WideBVH::Refit(const BVH& bvh, std::vector<WideBVHNode<Width>>& wideNodes) const
+	{
+		const std::vector<BVHNode>& nodes{ bvh.GetNodes() };
+		for (size_t wideIndex{}; wideIndex < wideNodes.size(); ++wideIndex)
+		{
+			WideBVHNode<Width>& wideNode{ wideNodes[wideIndex] };
+			for (int i{}; i < Width; ++i)
+			{
+				const uint32_t binaryIndex{ m_SlotNodes[wideIndex * Width + i] };
+				if (binaryIndex == InvalidNode)
+					continue;
+
+				const BVHNode& child{ nodes[binaryIndex] };
+				wideNode.minX[i] = child.minAABB.x;
+				wideNode.minY[i] = child.minAABB.y;
+				wideNode.minZ[i] = child.minAABB.z;
+				wideNode.maxX[i] = child.maxAABB.x;
+				wideNode.maxY[i] = child.maxAABB.y;
+				wideNode.maxZ[i] = child.maxAABB.z;
+			}
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "BVH.h"
+#include "Simd.h"
+
+namespace dae
+{
+	//Child boxes are stored per axis (SoA) so one SIMD compare tests the ray against every child
+	//interior child: child is the node index, primitiveCount is 0
+	//leaf child: child is the first primitive in the primitive index list
+	//unused slots have an inverted box that never passes the slab test
+	template<int Width>
+	struct alignas(sizeof(float) * Width) WideBVHNode
+	{
+		float minX[Width];
+		float minY[Width];
+		float minZ[Width];
+		float maxX[Width];
+		float maxY[Width];
+		float maxZ[Width];
+		uint32_t child[Width];
+		uint32_t primitiveCount[Width];
+	};
+
+	//Ray data in the form the child tests want it, near/far planes are picked once per ray from the direction signs
+	struct WideRay
+	{
+		float origin[3];
+		float invDirection[3];
+		//offset of the near and far plane arrays inside a node, per axis
+		int nearOffset[3];
+		int farOffset[3];
+		float min;
+		float max;
+	};
+
+	//Writes the entry distance of every child and returns a bit mask of the children the ray hits
+	uint32_t IntersectChildren_Scalar(const WideBVHNode<4>& node, const WideRay& ray, float* tEntries);
+	uint32_t IntersectChildren_SSE41(const WideBVHNode<4>& node, const WideRay& ray, float* tEntries);
+	uint32_t IntersectChildren_AVX2(const WideBVHNode<8>& node, const WideRay& ray, float* tEntries);
+
+	//4-wide (SSE4.1 or scalar) or 8-wide (AVX2) BVH collapsed from a binary BVH
+	//Call Update whenever the binary BVH was built or refitted, a refit only copies the child boxes again
+	class WideBVH final
+	{
+	public:
+		static constexpr int MaxWidth{ 8 };
+		//Every level pushes at most Width - 1 siblings, the binary BVH is never deeper than MaxDepth
+		static constexpr int StackSize{ BVH::MaxDepth * (MaxWidth - 1) + 1 };
+
+		void Build(const BVH& bvh);
+		//Falls back to the best supported level when the requested one is not available on this CPU
+		void Build(const BVH& bvh, SimdLevel simdLevel);
+		//Refits the child boxes in place while bvh keeps the topology it was collapsed from, collapses it again otherwise
+		void Update(const BVH& bvh);
+		void Clear();
+
+		bool IsEmpty() const { return m_PrimitiveIndices.empty(); }
+		SimdLevel GetSimdLevel() const { return m_SimdLevel; }
+		int GetWidth() const { return m_SimdLevel == SimdLevel::AVX2 ? 8 : 4; }
+
+		const std::vector<WideBVHNode<4>>& GetNodes4() const { return m_Nodes4; }
+		const std::vector<WideBVHNode<8>>& GetNodes8() const { return m_Nodes8; }
+		const std::vector<uint32_t>& GetPrimitiveIndices() const { return m_PrimitiveIndices; }
+
+	private:
+		SimdLevel m_SimdLevel{ SimdLevel::Scalar };
+		std::vector<WideBVHNode<4>> m_Nodes4{};
+		std::vector<WideBVHNode<8>> m_Nodes8{};
+		std::vector<uint32_t> m_PrimitiveIndices{};
+		//Binary node behind every child slot, Width slots per wide node, unused slots hold InvalidNode
+		static constexpr uint32_t InvalidNode{ UINT32_MAX };
+		std::vector<uint32_t> m_SlotNodes{};
+		uint64_t m_TopologyVersion{};
+
+		template<int Width>
+		void Collapse(const BVH& bvh, std::vector<WideBVHNode<Width>>& wideNodes);
+		template<int Width>
+		void Refit(const BVH& bvh, std::vector<WideBVHNode<Width>>& wideNodes) const;
+	};
+}
@@ -7,7 +7,12 @@
 #undef main
 
 //Standard includes
+#include <charconv>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <optional>
+#include <string>
 
 //Project includes
 #include "Timer.h"
@@ -16,23 +21,196 @@
 
 using namespace dae;
 
+struct Options
+{
+	std::string sceneName{ "W4" };
+	bool headless{ false };
+	int nrFrames{ 1 };
+	std::string outputPrefix{ "RayTracing_Frame" };
+	int width{ 640 };
+	int height{ 480 };
+	//0 uses every hardware thread
+	int nrThreads{ 0 };
+	//Accumulates jittered samples while nothing moves, on by default with a window
+	//Headless runs time every frame, so there it stays off unless asked for
+	std::optional<bool> progressive{};
+	bool antiAliasing{ false };
+	bool wavefront{ false };
+};
+
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
 	SDL_Quit();
 }
 
+Scene* CreateScene(const std::string& sceneName)
+{
+	if (sceneName == "W1")
+		return new Scene_W1();
+	if (sceneName == "W2")
+		return new Scene_W2();
+	if (sceneName == "W3")
+		return new Scene_W3();
+	if (sceneName == "W4")
+		return new Scene_W4();
+	if (sceneName == "W4Test")
+		return new Scene_W4_TestScene();
+	if (sceneName == "W4Reference")
+		return new Scene_W4_ReferenceScene();
+	if (sceneName == "Instancing")
+		return new Scene_Instancing();
+	return nullptr;
+}
+
+void PrintUsage()
+{
+	std::cout << "Usage: RayTracer [--scene W1|W2|W3|W4|W4Test|W4Reference|Instancing]\n"
+		<< "                 [--headless] [--frames N] [--output prefix] [--width W] [--height H] [--threads N] [--progressive|--no-progressive] [--aa] [--wavefront]\n"
+		<< "--headless renders N frames without a window and saves them as <prefix>_<frame>.bmp\n"
+		<< "           every frame is traced from scratch unless --progressive is given" << std::endl;
+}
+
+//The whole argument has to be a number, so "-5", "12px" or an overflow are not silently turned into something else
+bool ParseInt(const char* text, int& value)
+{
+	const char* pEnd{ text + std::strlen(text) };
+	const auto [pLast, error] { std::from_chars(text, pEnd, value) };
+	return error == std::errc{} && pLast == pEnd;
+}
+
+//Larger surfaces do not fit in memory anyway, the framebuffers alone take 12 bytes per pixel
+constexpr int MaxImageSize{ 16384 };
+
+bool ParseOptions(int argc, char* args[], Options& options)
+{
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		const std::string argument{ args[i] };
+		const bool hasValue{ i + 1 < argc };
+
+		if (argument == "--headless")
+			options.headless = true;
+		else if (argument == "--scene" && hasValue)
+			options.sceneName = args[++i];
+		else if (argument == "--frames" && hasValue)
+		{
+			if (!ParseInt(args[++i], options.nrFrames))
+				return false;
+		}
+		else if (argument == "--output" && hasValue)
+			options.outputPrefix = args[++i];
+		else if (argument == "--width" && hasValue)
+		{
+			if (!ParseInt(args[++i], options.width))
+				return false;
+		}
+		else if (argument == "--height" && hasValue)
+		{
+			if (!ParseInt(args[++i], options.height))
+				return false;
+		}
+		else if (argument == "--threads" && hasValue)
+		{
+			if (!ParseInt(args[++i], options.nrThreads))
+				return false;
+		}
+		else if (argument == "--progressive")
+			options.progressive = true;
+		else if (argument == "--no-progressive")
+			options.progressive = false;
+		else if (argument == "--aa")
+			options.antiAliasing = true;
+		else if (argument == "--wavefront")
+			options.wavefront = true;
+		else
+			return false;
+	}
+	return options.nrFrames > 0 && options.nrThreads >= 0
+		&& options.width > 0 && options.width <= MaxImageSize && options.height > 0 && options.height <= MaxImageSize;
+}
+
+//Render nodes have no display: no window, no event loop, every frame goes to a file
+int RunHeadless(const Options& options, Scene* pScene)
+{
+	const auto pTimer = new Timer();
+	const auto pRenderer = new Renderer(options.width, options.height);
+	if (!pRenderer->HasBuffer())
+	{
+		std::cout << "Could not create a " << options.width << "x" << options.height << " surface: " << SDL_GetError() << std::endl;
+		delete pRenderer;
+		delete pTimer;
+		return 1;
+	}
+	if (options.nrThreads > 0)
+		pRenderer->SetThreadCount(options.nrThreads);
+	pRenderer->SetProgressive(options.progressive.value_or(false));
+	pRenderer->SetAntiAliasing(options.antiAliasing);
+	pRenderer->SetWavefront(options.wavefront);
+
+	std::chrono::duration<double, std::milli> totalRenderTime{};
+	int frame{};
+	pTimer->Start();
+	for (; frame < options.nrFrames; ++frame)
+	{
+		pScene->Update(pTimer);
+
+		//Only the render itself is timed, saving the file is not part of a frame
+		const auto renderStart{ std::chrono::steady_clock::now() };
+		pRenderer->Render(pScene);
+		totalRenderTime += std::chrono::steady_clock::now() - renderStart;
+		pTimer->Update();
+
+		const std::string filePath{ options.outputPrefix + "_" + std::to_string(frame) + ".bmp" };
+		if (pRenderer->SaveBufferToImage(filePath.c_str()))
+		{
+			std::cout << "Could not save " << filePath << std::endl;
+			break;
+		}
+	}
+	pTimer->Stop();
+
+	if (frame > 0)
+	{
+		std::cout << "Rendered " << frame << " frame(s) of " << options.sceneName << ", "
+			<< totalRenderTime.count() / frame << " ms per frame" << std::endl;
+	}
+
+	delete pRenderer;
+	delete pTimer;
+	return frame == options.nrFrames ? 0 : 1;
+}
+
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	Options options{};
+	if (!ParseOptions(argc, args, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	const auto pScene = CreateScene(options.sceneName);
+	if (!pScene)
+	{
+		PrintUsage();
+		return 1;
+	}
+	pScene->Initialize();
+
+	if (options.headless)
+	{
+		const int result{ RunHeadless(options, pScene) };
+		delete pScene;
+		SDL_Quit();
+		return result;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
 
-	const uint32_t width = 640;
-	const uint32_t height = 480;
+	const int width = options.width;
+	const int height = options.height;
 
 	SDL_Window* pWindow = SDL_CreateWindow(
 		"RayTracer - **Insert Name**",
@@ -41,19 +219,19 @@ int main(int argc, char* args[])
 		width, height, 0);
 
 	if (!pWindow)
+	{
+		delete pScene;
 		return 1;
+	}
 
 	//Initialize "framework"
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
-
-	//const auto pScene = new Scene_W1();
-	//const auto pScene = new Scene_W2();
-	//const auto pScene = new Scene_W3();
-	const auto pScene = new Scene_W4();
-	//const auto pScene = new Scene_W4_TestScene();
-	//const auto pScene = new Scene_W4_ReferenceScene();
-	pScene->Initialize();
+	if (options.nrThreads > 0)
+		pRenderer->SetThreadCount(options.nrThreads);
+	pRenderer->SetProgressive(options.progressive.value_or(true));
+	pRenderer->SetAntiAliasing(options.antiAliasing);
+	pRenderer->SetWavefront(options.wavefront);
 
 	//Start loop
 	pTimer->Start();
@@ -93,6 +271,21 @@ int main(int argc, char* args[])
 				case SDL_SCANCODE_F3:
 					pRenderer->CycleLightingMode();
 					break;
+				case SDL_SCANCODE_F4:
+					pRenderer->CycleToneMapping();
+					break;
+				case SDL_SCANCODE_F5:
+					pRenderer->ToggleGammaCorrection();
+					break;
+				case SDL_SCANCODE_F6:
+					pRenderer->ToggleProgressive();
+					break;
+				case SDL_SCANCODE_F7:
+					pRenderer->ToggleAntiAliasing();
+					break;
+				case SDL_SCANCODE_F8:
+					pRenderer->ToggleWavefront();
+					break;
 				default:
 					break;
 				}
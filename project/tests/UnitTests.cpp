@@ -2,6 +2,19 @@
 #include "../src/Vector3.h"
 #include "../src/Vector4.h"
 #include "../src/Matrix.h"
+#include "../src/Utils.h"
+#include "../src/Scene.h"
+#include "../src/FrameBuffer.h"
+#include "../src/Material.h"
+#include "../src/MeshCache.h"
+#include "../src/OBJLoader.h"
+#include "../src/Renderer.h"
+#include "../src/TileScheduler.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
 
 namespace dae
 {
@@ -35,8 +48,1069 @@ namespace dae
 		EXPECT_EQ(dae::Vector3(-3.0f, 6.0f, -3.0f), dae::Vector3::Cross(v1, v2));
 	}
 
+	// The header math is usable at compile time, the rsqrt normalize stays within a few ulp of the exact one
+	TEST(Vector3, ConstexprMathAndFastNormalize) {
+		static_assert(Vector3::Dot({ 1.f, 2.f, 3.f }, { 4.f, 5.f, 6.f }) == 32.f);
+		static_assert(Vector3::Cross(Vector3::UnitZ, Vector3::UnitX).y == 1.f);
+		static_assert((Matrix::CreateScale(2.f, 2.f, 2.f) * Matrix::CreateTranslation(1.f, 2.f, 3.f)).TransformPoint(Vector3{ 1.f, 1.f, 1.f }).z == 5.f);
+
+		std::mt19937 generator{ 13 };
+		std::uniform_real_distribution<float> exponent{ -10.f, 10.f };
+		std::uniform_real_distribution<float> component{ -1.f, 1.f };
+		for (int i{}; i < 10000; ++i)
+		{
+			const Vector3 v{ Vector3{ component(generator), component(generator), component(generator) } * std::exp2(exponent(generator)) };
+			const Vector3 exact{ v.Normalized() };
+			const Vector3 fast{ v.NormalizedFast() };
+			EXPECT_NEAR(exact.x, fast.x, 5e-7f);
+			EXPECT_NEAR(exact.y, fast.y, 5e-7f);
+			EXPECT_NEAR(exact.z, fast.z, 5e-7f);
+		}
+	}
+
 	// W1
 
+	TEST(Matrix, Inverse) {
+		const Matrix transform{ Matrix::CreateScale(2.f, .5f, 3.f) * Matrix::CreateRotation(.3f, 1.2f, -.4f) * Matrix::CreateTranslation(4.f, -1.f, 2.f) };
+		const Matrix identity{ transform * Matrix::Inverse(transform) };
+		for (int r{}; r < 4; ++r)
+		{
+			for (int c{}; c < 4; ++c)
+			{
+				EXPECT_NEAR(r == c ? 1.f : 0.f, identity[r][c], 1e-5f);
+			}
+		}
+
+		const Vector3 point{ 1.f, 2.f, 3.f };
+		const Vector3 roundTrip{ Matrix::Inverse(transform).TransformPoint(transform.TransformPoint(point)) };
+		EXPECT_NEAR(0.f, (roundTrip - point).Magnitude(), 1e-5f);
+	}
+
+	TEST(Triangle, HitTestBarycentricsAndCulling) {
+		Triangle triangle{ { -1.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 2.f, 0.f } };
+		triangle.cullMode = TriangleCullMode::NoCulling;
+		const Ray frontRay{ { .2f, .5f, 3.f }, { 0.f, 0.f, -1.f } };
+
+		HitRecord hitRecord{};
+		ASSERT_TRUE(GeometryUtils::HitTest_Triangle(triangle, frontRay, hitRecord));
+		EXPECT_NEAR(3.f, hitRecord.t, 1e-5f);
+		const Vector3 interpolated{ triangle.v0 * (1.f - hitRecord.u - hitRecord.v) + triangle.v1 * hitRecord.u + triangle.v2 * hitRecord.v };
+		EXPECT_NEAR(0.f, (interpolated - hitRecord.origin).Magnitude(), 1e-5f);
+
+		// The normal points to +z, so a ray going to -z sees the front face
+		const Ray backRay{ { .2f, .5f, -3.f }, { 0.f, 0.f, 1.f } };
+		triangle.cullMode = TriangleCullMode::BackFaceCulling;
+		EXPECT_TRUE(GeometryUtils::HitTest_Triangle(triangle, frontRay));
+		EXPECT_FALSE(GeometryUtils::HitTest_Triangle(triangle, backRay));
+		triangle.cullMode = TriangleCullMode::FrontFaceCulling;
+		EXPECT_FALSE(GeometryUtils::HitTest_Triangle(triangle, frontRay));
+		EXPECT_TRUE(GeometryUtils::HitTest_Triangle(triangle, backRay));
+
+		const Ray missRay{ { 1.f, 1.5f, 3.f }, { 0.f, 0.f, -1.f } };
+		EXPECT_FALSE(GeometryUtils::HitTest_Triangle(triangle, missRay));
+	}
+
+	// Random triangle soup used by the acceleration structure tests
+	static TriangleMesh CreateRandomTriangleMesh(int nrTriangles, unsigned int seed, TriangleMeshTransformMode transformMode = TriangleMeshTransformMode::WorldSpace)
+	{
+		std::mt19937 generator{ seed };
+		std::uniform_real_distribution<float> position{ -5.f, 5.f };
+		std::uniform_real_distribution<float> offset{ -.5f, .5f };
+
+		std::vector<Vector3> positions{};
+		std::vector<int> indices{};
+		for (int i{}; i < nrTriangles; ++i)
+		{
+			const Vector3 center{ position(generator), position(generator), position(generator) };
+			for (int v{}; v < 3; ++v)
+			{
+				indices.push_back(static_cast<int>(positions.size()));
+				positions.push_back(center + Vector3{ offset(generator), offset(generator), offset(generator) });
+			}
+		}
+		TriangleMesh mesh{ positions, indices, TriangleCullMode::NoCulling };
+		mesh.transformMode = transformMode;
+		mesh.RebuildBVH();
+		return mesh;
+	}
+
+	static Ray CreateRandomRay(std::mt19937& generator)
+	{
+		std::uniform_real_distribution<float> distribution{ -1.f, 1.f };
+		const Vector3 origin{ distribution(generator) * 10.f, distribution(generator) * 10.f, -10.f };
+		const Vector3 target{ distribution(generator) * 5.f, distribution(generator) * 5.f, distribution(generator) * 5.f };
+		return Ray{ origin, (target - origin).Normalized() };
+	}
+
+	static void ExpectMeshMatchesBruteForce(const TriangleMesh& mesh, unsigned int seed)
+	{
+		std::mt19937 generator{ seed };
+		for (int i{}; i < 500; ++i)
+		{
+			const Ray ray{ CreateRandomRay(generator) };
+
+			HitRecord expected{};
+			for (size_t triangleIndex{}; triangleIndex < mesh.indices.size() / 3; ++triangleIndex)
+			{
+				Triangle triangle{ mesh.transformedPositions[mesh.indices[triangleIndex * 3]],
+					mesh.transformedPositions[mesh.indices[triangleIndex * 3 + 1]],
+					mesh.transformedPositions[mesh.indices[triangleIndex * 3 + 2]],
+					mesh.transformedNormals[triangleIndex] };
+				triangle.cullMode = mesh.cullMode;
+
+				HitRecord candidate{};
+				if (GeometryUtils::HitTest_Triangle(triangle, ray, candidate) && candidate.t < expected.t)
+					expected = candidate;
+			}
+
+			HitRecord actual{};
+			GeometryUtils::HitTest_TriangleMesh(mesh, ray, actual);
+
+			EXPECT_EQ(expected.didHit, actual.didHit);
+			EXPECT_NEAR(expected.t, actual.t, 1e-3f);
+			EXPECT_EQ(expected.didHit, GeometryUtils::HitTest_TriangleMesh(mesh, ray));
+		}
+	}
+
+	// BVH traversal has to find exactly what a test against every triangle finds
+	TEST(BVH, TriangleMeshMatchesBruteForce) {
+		const TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42) };
+		ExpectMeshMatchesBruteForce(mesh, 7);
+	}
+
+	// The linear builder trades tree quality for build time, never correctness
+	TEST(BVH, LinearBuildMatchesBruteForce) {
+		TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42) };
+		mesh.SetBVHBuildMode(BVHBuildMode::Linear);
+		ExpectMeshMatchesBruteForce(mesh, 7);
+
+		// 63 bit Morton codes are only used for big meshes
+		TriangleMesh bigMesh{ CreateRandomTriangleMesh(70000, 43) };
+		bigMesh.SetBVHBuildMode(BVHBuildMode::Linear);
+		ExpectMeshMatchesBruteForce(bigMesh, 7);
+
+		// A refit must find the bounds of the linear layout too
+		mesh.bvh.SetRebuildThreshold(FLT_MAX);
+		mesh.RotateY(.4f);
+		mesh.Translate({ 0.f, .5f, 0.f });
+		mesh.UpdateTransforms();
+		ExpectMeshMatchesBruteForce(mesh, 9);
+	}
+
+	// Every child test (scalar, SSE4.1, AVX2) must give the same hits, levels the CPU lacks fall back to a supported one
+	TEST(BVH, WideBVHMatchesBruteForce) {
+		TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42) };
+		for (SimdLevel simdLevel : { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 })
+		{
+			mesh.wideBVH.Build(mesh.bvh, simdLevel);
+			EXPECT_LE(mesh.wideBVH.GetSimdLevel(), simdLevel);
+			ExpectMeshMatchesBruteForce(mesh, 11);
+		}
+	}
+
+	static std::vector<uint32_t> GetWideChildren(const WideBVH& wideBVH)
+	{
+		std::vector<uint32_t> children{};
+		for (const WideBVHNode<4>& node : wideBVH.GetNodes4())
+		{
+			children.insert(children.end(), std::begin(node.child), std::end(node.child));
+		}
+		for (const WideBVHNode<8>& node : wideBVH.GetNodes8())
+		{
+			children.insert(children.end(), std::begin(node.child), std::end(node.child));
+		}
+		return children;
+	}
+
+	// A refitted BVH keeps its topology but must still bound the moved triangles
+	// The wide BVH refits its child boxes in place instead of collapsing the tree again
+	TEST(BVH, RefitMatchesBruteForce) {
+		for (SimdLevel simdLevel : { SimdLevel::SSE41, SimdLevel::AVX2 })
+		{
+			TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42) };
+			mesh.bvh.SetRebuildThreshold(FLT_MAX);
+			mesh.wideBVH.Build(mesh.bvh, simdLevel);
+			const SimdLevel wideSimdLevel{ mesh.wideBVH.GetSimdLevel() };
+			const std::vector<uint32_t> wideChildren{ GetWideChildren(mesh.wideBVH) };
+			const size_t nrNodes{ mesh.bvh.GetNodes().size() };
+			for (int frame{}; frame < 3; ++frame)
+			{
+				mesh.RotateY(.4f * frame);
+				mesh.Translate({ 0.f, .5f * frame, 0.f });
+				mesh.UpdateTransforms();
+				ExpectMeshMatchesBruteForce(mesh, 7 + frame);
+				EXPECT_EQ(wideSimdLevel, mesh.wideBVH.GetSimdLevel());
+				EXPECT_EQ(wideChildren, GetWideChildren(mesh.wideBVH));
+			}
+			EXPECT_EQ(nrNodes, mesh.bvh.GetNodes().size());
+		}
+	}
+
+	// Moving the ray into object space has to give the same hits as transforming every vertex
+	TEST(BVH, ObjectSpaceMatchesWorldSpace) {
+		TriangleMesh worldSpaceMesh{ CreateRandomTriangleMesh(2000, 42, TriangleMeshTransformMode::WorldSpace) };
+		TriangleMesh objectSpaceMesh{ CreateRandomTriangleMesh(2000, 42, TriangleMeshTransformMode::ObjectSpace) };
+		for (TriangleMesh* pMesh : { &worldSpaceMesh, &objectSpaceMesh })
+		{
+			pMesh->Scale({ 1.5f, 1.5f, 1.5f });
+			pMesh->RotateY(.7f);
+			pMesh->Translate({ 1.f, -2.f, .5f });
+			pMesh->UpdateTransforms();
+		}
+
+		std::mt19937 generator{ 5 };
+		for (int i{}; i < 500; ++i)
+		{
+			const Ray ray{ CreateRandomRay(generator) };
+
+			HitRecord expected{};
+			GeometryUtils::HitTest_TriangleMesh(worldSpaceMesh, ray, expected);
+			HitRecord actual{};
+			GeometryUtils::HitTest_TriangleMesh(objectSpaceMesh, ray, actual);
+
+			ASSERT_EQ(expected.didHit, actual.didHit);
+			if (!expected.didHit)
+				continue;
+
+			EXPECT_NEAR(expected.t, actual.t, 1e-3f);
+			EXPECT_NEAR(1.f, Vector3::Dot(expected.normal.Normalized(), actual.normal.Normalized()), 1e-3f);
+		}
+	}
+
+	// Switching the mode of a built mesh must give the hits of a mesh that was built in the new mode
+	TEST(BVH, SwitchingTransformModeRebuilds) {
+		TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42, TriangleMeshTransformMode::WorldSpace) };
+		for (const TriangleMeshTransformMode transformMode : { TriangleMeshTransformMode::ObjectSpace, TriangleMeshTransformMode::WorldSpace })
+		{
+			TriangleMesh reference{ CreateRandomTriangleMesh(2000, 42, transformMode) };
+			for (TriangleMesh* pMesh : { &mesh, &reference })
+			{
+				pMesh->transformMode = transformMode;
+				pMesh->Scale({ 1.5f, 1.5f, 1.5f });
+				pMesh->RotateY(.7f);
+				pMesh->Translate({ 1.f, -2.f, .5f });
+				pMesh->UpdateTransforms();
+			}
+			EXPECT_EQ(reference.transformedMinAABB, mesh.transformedMinAABB);
+			EXPECT_EQ(reference.transformedMaxAABB, mesh.transformedMaxAABB);
+
+			std::mt19937 generator{ 9 };
+			for (int i{}; i < 500; ++i)
+			{
+				const Ray ray{ CreateRandomRay(generator) };
+
+				HitRecord expected{};
+				GeometryUtils::HitTest_TriangleMesh(reference, ray, expected);
+				HitRecord actual{};
+				GeometryUtils::HitTest_TriangleMesh(mesh, ray, actual);
+
+				ASSERT_EQ(expected.didHit, actual.didHit);
+				EXPECT_EQ(expected.t, actual.t);
+			}
+		}
+	}
+
+	// An instance must hit exactly what a mesh with the same geometry and transform hits
+	TEST(BVH, InstanceMatchesTriangleMesh) {
+		TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42, TriangleMeshTransformMode::ObjectSpace) };
+		const MeshGeometry geometry{ mesh.positions, mesh.normals, mesh.indices };
+		TriangleMeshInstance instance{};
+		instance.pGeometry = &geometry;
+		instance.cullMode = mesh.cullMode;
+
+		mesh.Scale({ 1.5f, 1.5f, 1.5f });
+		mesh.RotateY(.7f);
+		mesh.Translate({ 1.f, -2.f, .5f });
+		mesh.UpdateTransforms();
+		instance.Scale({ 1.5f, 1.5f, 1.5f });
+		instance.RotateY(.7f);
+		instance.Translate({ 1.f, -2.f, .5f });
+		instance.UpdateTransforms();
+
+		std::mt19937 generator{ 5 };
+		for (int i{}; i < 500; ++i)
+		{
+			const Ray ray{ CreateRandomRay(generator) };
+
+			HitRecord expected{};
+			GeometryUtils::HitTest_TriangleMesh(mesh, ray, expected);
+			HitRecord actual{};
+			GeometryUtils::HitTest_TriangleMeshInstance(instance, ray, actual);
+
+			ASSERT_EQ(expected.didHit, actual.didHit);
+			ASSERT_EQ(expected.didHit, GeometryUtils::HitTest_TriangleMeshInstance(instance, ray));
+			if (!expected.didHit)
+				continue;
+
+			EXPECT_NEAR(expected.t, actual.t, 1e-4f);
+			EXPECT_NEAR(1.f, Vector3::Dot(expected.normal.Normalized(), actual.normal.Normalized()), 1e-4f);
+		}
+	}
+
+	// The SoA kernels use the scalar formulas, so every level must return the same primitive at the same distance
+	TEST(PrimitiveSoA, MatchesScalarHitTests) {
+		std::mt19937 generator{ 5 };
+		std::uniform_real_distribution<float> position{ -5.f, 5.f };
+		std::uniform_real_distribution<float> direction{ -1.f, 1.f };
+
+		// Counts that are not a multiple of the SIMD width exercise the padding
+		std::vector<Sphere> spheres(37);
+		for (Sphere& sphere : spheres)
+		{
+			sphere = { { position(generator), position(generator), position(generator) }, .2f + (position(generator) + 5.f) * .1f };
+		}
+		std::vector<Plane> planes(13);
+		for (Plane& plane : planes)
+		{
+			plane = { { position(generator), position(generator), position(generator) + 10.f }, Vector3{ direction(generator), direction(generator), direction(generator) }.Normalized() };
+		}
+
+		for (SimdLevel simdLevel : { SimdLevel::Scalar, SimdLevel::SSE41, SimdLevel::AVX2 })
+		{
+			SphereSoA sphereSoA{};
+			sphereSoA.Build(spheres, simdLevel);
+			PlaneSoA planeSoA{};
+			planeSoA.Build(planes, simdLevel);
+			EXPECT_LE(sphereSoA.simdLevel, simdLevel);
+
+			std::mt19937 rayGenerator{ 13 };
+			for (int i{}; i < 500; ++i)
+			{
+				// Every other ray starts inside the sphere field, so some start inside a sphere
+				Ray ray{ CreateRandomRay(rayGenerator) };
+				if (i % 2 == 1)
+					ray.origin = spheres[i % spheres.size()].origin;
+
+				int expectedSphere{ -1 };
+				HitRecord expectedSphereHit{};
+				for (size_t s{}; s < spheres.size(); ++s)
+				{
+					Ray closestRay{ ray };
+					closestRay.max = expectedSphereHit.t;
+					if (GeometryUtils::HitTest_Sphere(spheres[s], closestRay, expectedSphereHit))
+						expectedSphere = static_cast<int>(s);
+				}
+
+				int expectedPlane{ -1 };
+				HitRecord expectedPlaneHit{};
+				for (size_t p{}; p < planes.size(); ++p)
+				{
+					if (GeometryUtils::HitTest_Plane(planes[p], ray, expectedPlaneHit))
+						expectedPlane = static_cast<int>(p);
+				}
+
+				float t{};
+				EXPECT_EQ(expectedSphere, IntersectSpheres(sphereSoA, ray, t));
+				if (expectedSphere >= 0)
+				{
+					EXPECT_EQ(expectedSphereHit.t, t);
+				}
+				EXPECT_EQ(expectedSphere >= 0, IntersectSpheres(sphereSoA, ray, t, true) >= 0);
+
+				EXPECT_EQ(expectedPlane, IntersectPlanes(planeSoA, ray, t));
+				if (expectedPlane >= 0)
+				{
+					EXPECT_EQ(expectedPlaneHit.t, t);
+				}
+				EXPECT_EQ(expectedPlane >= 0, IntersectPlanes(planeSoA, ray, t, true) >= 0);
+			}
+		}
+	}
+
+	class SphereFieldScene final : public Scene
+	{
+	public:
+		void Initialize() override
+		{
+			std::mt19937 generator{ 3 };
+			std::uniform_real_distribution<float> position{ -5.f, 5.f };
+			std::uniform_real_distribution<float> radius{ .05f, .3f };
+			for (int i{}; i < 1000; ++i)
+			{
+				AddSphere({ position(generator), position(generator), position(generator) }, radius(generator));
+			}
+			AddPlane({ 0.f, -6.f, 0.f }, { 0.f, 1.f, 0.f });
+		}
+	};
+
+	// The top-level BVH must return the closest of all spheres and planes
+	TEST(BVH, SceneMatchesBruteForce) {
+		SphereFieldScene scene{};
+		scene.Initialize();
+		scene.UpdateAccelerationStructure();
+		std::mt19937 generator{ 11 };
+
+		for (int i{}; i < 500; ++i)
+		{
+			const Ray ray{ CreateRandomRay(generator) };
+
+			float expectedT{ FLT_MAX };
+			for (const Sphere& sphere : scene.GetSphereGeometries())
+			{
+				HitRecord candidate{};
+				if (GeometryUtils::HitTest_Sphere(sphere, ray, candidate))
+					expectedT = std::min(expectedT, candidate.t);
+			}
+			for (const Plane& plane : scene.GetPlaneGeometries())
+			{
+				HitRecord candidate{};
+				if (GeometryUtils::HitTest_Plane(plane, ray, candidate))
+					expectedT = std::min(expectedT, candidate.t);
+			}
+
+			HitRecord actual{};
+			scene.GetClosestHit(ray, actual);
+
+			EXPECT_EQ(expectedT < FLT_MAX, actual.didHit);
+			EXPECT_FLOAT_EQ(expectedT, actual.t);
+			EXPECT_EQ(expectedT < FLT_MAX, scene.DoesHit(ray));
+		}
+	}
+
+	class OccluderScene final : public Scene
+	{
+	public:
+		void Initialize() override
+		{
+			const TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42) };
+			const MeshGeometry* pGeometry{ AddMeshGeometry(mesh.positions, mesh.normals, mesh.indices) };
+			for (float x : { -3.f, 3.f })
+			{
+				TriangleMeshInstance* pInstance{ AddTriangleMeshInstance(pGeometry, TriangleCullMode::BackFaceCulling) };
+				pInstance->Translate({ x, 0.f, 0.f });
+				pInstance->UpdateTransforms();
+			}
+			AddSphere({ 0.f, 3.f, 0.f }, 1.f);
+			AddSphere({ 0.f, -3.f, 2.f }, .5f);
+			AddPlane({ 0.f, -6.f, 0.f }, { 0.f, 1.f, 0.f });
+		}
+	};
+
+	// A cached occluder only decides which primitive is tested first, never whether the ray is blocked
+	TEST(Occlusion, CachedOccluderMatchesUncached) {
+		OccluderScene scene{};
+		scene.Initialize();
+		scene.UpdateAccelerationStructure();
+		std::mt19937 generator{ 17 };
+		std::uniform_real_distribution<float> length{ 1.f, 25.f };
+
+		OccluderCache occluder{};
+		int nrOccluded{};
+		for (int i{}; i < 1000; ++i)
+		{
+			Ray ray{ CreateRandomRay(generator) };
+			ray.max = length(generator);
+
+			// Stale entries from another scene must be ignored
+			if (i % 100 == 0)
+				occluder = { OccluderCache::Type::TriangleMeshInstance, 7, 100000 };
+
+			const bool expected{ scene.DoesHit(ray) };
+			EXPECT_EQ(expected, scene.DoesHit(ray, occluder));
+			if (expected)
+			{
+				++nrOccluded;
+				EXPECT_NE(OccluderCache::Type::None, occluder.type);
+			}
+		}
+		EXPECT_GT(nrOccluded, 0);
+	}
+
+	// Stealing moves tiles between threads, but every tile of every frame must still run exactly once
+	TEST(TileScheduler, RunsEveryTileOnce) {
+		TileScheduler scheduler{};
+		scheduler.Start(4);
+		EXPECT_EQ(4, scheduler.GetThreadCount());
+
+		std::vector<std::atomic<int>> counts(1200);
+		for (uint32_t nrTiles : { 0u, 1u, 3u, 97u, 1200u })
+		{
+			for (std::atomic<int>& count : counts)
+			{
+				count = 0;
+			}
+
+			auto countTile{ [&](uint32_t tileIndex) { ++counts[tileIndex]; } };
+			scheduler.Run(nrTiles, countTile);
+
+			for (uint32_t i{}; i < counts.size(); ++i)
+			{
+				EXPECT_EQ(i < nrTiles ? 1 : 0, counts[i].load());
+			}
+		}
+	}
+
+	// The AVX2 resolve must write the same pixels as the scalar one, MaxToOne must match the old per-pixel path
+	TEST(FrameBuffer, ResolveMatchesScalar) {
+		// Not a multiple of 8, so the scalar tail runs too
+		FrameBuffer frameBuffer{};
+		frameBuffer.Resize(101, 3);
+		std::mt19937 generator{ 23 };
+		std::uniform_real_distribution<float> radiance{ -.2f, 3.f };
+		const int nrPixels{ frameBuffer.GetWidth() * frameBuffer.GetHeight() };
+		for (int i{}; i < nrPixels; ++i)
+		{
+			frameBuffer.SetPixel(i, { radiance(generator), radiance(generator), radiance(generator) });
+		}
+
+		std::vector<uint32_t> scalarPixels(nrPixels);
+		std::vector<uint32_t> simdPixels(nrPixels);
+		for (ToneMapping toneMapping : { ToneMapping::MaxToOne, ToneMapping::Clamp, ToneMapping::Reinhard, ToneMapping::ACES })
+		{
+			for (bool gammaCorrection : { false, true })
+			{
+				const ResolveSettings settings{ toneMapping, gammaCorrection, { 0, 8, 16, 0xFF000000 } };
+				frameBuffer.Resolve(scalarPixels.data(), 0, nrPixels, settings, SimdLevel::Scalar);
+				frameBuffer.Resolve(simdPixels.data(), 0, nrPixels, settings, SimdLevel::AVX2);
+				EXPECT_EQ(scalarPixels, simdPixels);
+			}
+		}
+
+		frameBuffer.Resolve(simdPixels.data(), 0, nrPixels, {});
+		for (int i{}; i < nrPixels; ++i)
+		{
+			ColorRGB color{ frameBuffer.GetPixel(i) };
+			color.MaxToOne();
+			const uint32_t red{ static_cast<uint32_t>(std::clamp(color.r, 0.f, 1.f) * 255) };
+			const uint32_t green{ static_cast<uint32_t>(std::clamp(color.g, 0.f, 1.f) * 255) };
+			const uint32_t blue{ static_cast<uint32_t>(std::clamp(color.b, 0.f, 1.f) * 255) };
+			EXPECT_EQ(red << 16 | green << 8 | blue, simdPixels[i]);
+		}
+	}
+
+	class VersionScene final : public Scene
+	{
+	public:
+		void Initialize() override
+		{
+			pSphere = AddSphere({ 0.f, 0.f, 5.f }, 1.f);
+			pLight = AddPointLight({ 0.f, 5.f, 0.f }, 50.f, colors::White);
+		}
+
+		Sphere* pSphere{ nullptr };
+		Light* pLight{ nullptr };
+	};
+
+	class MovingMeshScene final : public Scene
+	{
+	public:
+		explicit MovingMeshScene(TriangleMeshTransformMode transformMode)
+			: m_TransformMode{ transformMode }
+		{
+		}
+
+		void Initialize() override
+		{
+			pMesh = AddTriangleMesh(TriangleCullMode::NoCulling);
+			pMesh->transformMode = m_TransformMode;
+			pMesh->AppendTriangle({ { -1.f, 0.f, 5.f }, { 1.f, 0.f, 5.f }, { 0.f, 1.f, 5.f } });
+			AddPointLight({ 0.f, 5.f, 0.f }, 50.f, colors::White);
+		}
+
+		TriangleMesh* pMesh{ nullptr };
+
+	private:
+		TriangleMeshTransformMode m_TransformMode;
+	};
+
+	// Progressive rendering only keeps accumulating while the version stays the same
+	TEST(Scene, VersionChangesWithState) {
+		VersionScene scene{};
+		scene.Initialize();
+		scene.UpdateAccelerationStructure();
+		const uint64_t version{ scene.GetVersion() };
+
+		scene.UpdateAccelerationStructure();
+		EXPECT_EQ(version, scene.GetVersion());
+
+		scene.pSphere->origin.x += .5f;
+		scene.UpdateAccelerationStructure();
+		EXPECT_NE(version, scene.GetVersion());
+
+		const uint64_t movedVersion{ scene.GetVersion() };
+		scene.pLight->intensity *= 2.f;
+		scene.UpdateAccelerationStructure();
+		EXPECT_NE(movedVersion, scene.GetVersion());
+
+		for (const TriangleMeshTransformMode transformMode : { TriangleMeshTransformMode::WorldSpace, TriangleMeshTransformMode::ObjectSpace })
+		{
+			MovingMeshScene meshScene{ transformMode };
+			meshScene.Initialize();
+			meshScene.UpdateAccelerationStructure();
+			const uint64_t meshVersion{ meshScene.GetVersion() };
+
+			meshScene.pMesh->UpdateTransforms();
+			meshScene.UpdateAccelerationStructure();
+			EXPECT_EQ(meshVersion, meshScene.GetVersion());
+
+			meshScene.pMesh->Translate({ 5.f, 0.f, 0.f });
+			meshScene.pMesh->UpdateTransforms();
+			meshScene.UpdateAccelerationStructure();
+			EXPECT_NE(meshVersion, meshScene.GetVersion());
+		}
+	}
+
+	// Only pixels near the silhouette get extra samples, and never more than the budget allows
+	TEST(AntiAliasing, RefinesEdgesWithinBudget) {
+		VersionScene scene{};
+		scene.Initialize();
+		Renderer renderer{ 64, 48 };
+		renderer.SetProgressive(false);
+		renderer.Render(&scene);
+		const FrameBuffer singleSample{ renderer.GetFrameBuffer() };
+
+		constexpr float budget{ .5f };
+		renderer.SetAntiAliasing(true);
+		renderer.SetAASampleBudget(budget);
+		renderer.Render(&scene);
+		EXPECT_GT(renderer.GetNrAASamples(), 0);
+		EXPECT_LE(renderer.GetNrAASamples(), static_cast<int>(budget * 64 * 48));
+
+		int nrRefined{};
+		for (int i{}; i < 64 * 48; ++i)
+		{
+			const ColorRGB before{ singleSample.GetPixel(i) };
+			const ColorRGB after{ renderer.GetFrameBuffer().GetPixel(i) };
+			if (before.r != after.r || before.g != after.g || before.b != after.b)
+				++nrRefined;
+		}
+		EXPECT_GT(nrRefined, 0);
+		EXPECT_LT(nrRefined, 64 * 48 / 4);
+	}
+
+	class ShadowScene final : public Scene
+	{
+	public:
+		void Initialize() override
+		{
+			AddSphere({ -1.f, 0.f, 6.f }, 1.f);
+			AddSphere({ 1.5f, .5f, 7.f }, .75f);
+			AddPlane({ 0.f, -1.f, 0.f }, { 0.f, 1.f, 0.f });
+			AddPointLight({ 0.f, 5.f, 4.f }, 50.f, colors::White);
+			AddPointLight({ -4.f, 3.f, 2.f }, 30.f, colors::White);
+		}
+	};
+
+	static bool FrameBuffersMatch(const FrameBuffer& a, const FrameBuffer& b)
+	{
+		for (int i{}; i < a.GetWidth() * a.GetHeight(); ++i)
+		{
+			const ColorRGB colorA{ a.GetPixel(i) };
+			const ColorRGB colorB{ b.GetPixel(i) };
+			if (colorA.r != colorB.r || colorA.g != colorB.g || colorA.b != colorB.b)
+				return false;
+		}
+		return true;
+	}
+
+	// Rays around one random ray, a small spread gives a coherent camera-like packet, a large one sends every ray its own way
+	static RayPacket CreateRandomPacket(std::mt19937& generator, int size, float spread)
+	{
+		std::uniform_real_distribution<float> offset{ -1.f, 1.f };
+		const Ray centerRay{ CreateRandomRay(generator) };
+		RayPacket packet{};
+		packet.origin = centerRay.origin;
+		packet.size = size;
+		for (int i{}; i < size; ++i)
+		{
+			const Vector3 direction{ (centerRay.direction + Vector3{ offset(generator), offset(generator), offset(generator) } * spread).Normalized() };
+			packet.directionX[i] = direction.x;
+			packet.directionY[i] = direction.y;
+			packet.directionZ[i] = direction.z;
+			packet.max[i] = FLT_MAX;
+		}
+		return packet;
+	}
+
+	// Every packet size, including the partial ones a tile edge leaves, for coherent and widely diverging packets
+	template<typename ClosestHit, typename ClosestHits>
+	static void ExpectPacketsMatchSingleRays(ClosestHit&& getClosestHit, ClosestHits&& getClosestHits, unsigned int seed)
+	{
+		std::mt19937 generator{ seed };
+		int nrHits{};
+		for (int size{ 1 }; size <= RayPacket::MaxSize; ++size)
+		{
+			for (const float spread : { .01f, .2f, 2.f })
+			{
+				RayPacket packet{ CreateRandomPacket(generator, size, spread) };
+				Ray rays[RayPacket::MaxSize];
+				for (int i{}; i < size; ++i)
+				{
+					rays[i] = packet.GetRay(i);
+				}
+
+				HitRecord hitRecords[RayPacket::MaxSize]{};
+				getClosestHits(packet, hitRecords);
+				for (int i{}; i < size; ++i)
+				{
+					HitRecord expected{};
+					getClosestHit(rays[i], expected);
+
+					ASSERT_EQ(expected.didHit, hitRecords[i].didHit) << "packet size " << size << ", ray " << i;
+					if (!expected.didHit)
+						continue;
+
+					++nrHits;
+					EXPECT_EQ(expected.t, hitRecords[i].t);
+					EXPECT_EQ(expected.u, hitRecords[i].u);
+					EXPECT_EQ(expected.v, hitRecords[i].v);
+					EXPECT_EQ(expected.origin, hitRecords[i].origin);
+					EXPECT_EQ(expected.normal, hitRecords[i].normal);
+					EXPECT_EQ(expected.materialIndex, hitRecords[i].materialIndex);
+				}
+			}
+		}
+		EXPECT_GT(nrHits, 0);
+	}
+
+	// Packets cull BVH nodes for all their rays at once, the hits must still be the ones every ray finds on its own
+	TEST(BVH, PacketTraversalMatchesSingleRays) {
+		SphereFieldScene sphereField{};
+		sphereField.Initialize();
+		sphereField.UpdateAccelerationStructure();
+		OccluderScene occluders{};
+		occluders.Initialize();
+		occluders.UpdateAccelerationStructure();
+
+		unsigned int seed{ 19 };
+		for (const Scene* pScene : { static_cast<const Scene*>(&sphereField), static_cast<const Scene*>(&occluders) })
+		{
+			ExpectPacketsMatchSingleRays(
+				[&](const Ray& ray, HitRecord& hitRecord) { pScene->GetClosestHit(ray, hitRecord); },
+				[&](RayPacket& packet, HitRecord* hitRecords) { pScene->GetClosestHits(packet, hitRecords); },
+				seed++);
+		}
+
+		// Scene meshes are not in either scene, so their packet test is checked on its own
+		for (const TriangleMeshTransformMode transformMode : { TriangleMeshTransformMode::WorldSpace, TriangleMeshTransformMode::ObjectSpace })
+		{
+			TriangleMesh mesh{ CreateRandomTriangleMesh(2000, 42, transformMode) };
+			mesh.RotateY(.7f);
+			mesh.Translate({ 1.f, -2.f, .5f });
+			mesh.UpdateTransforms();
+			ExpectPacketsMatchSingleRays(
+				[&](const Ray& ray, HitRecord& hitRecord) { GeometryUtils::HitTest_TriangleMesh(mesh, ray, hitRecord); },
+				[&](RayPacket& packet, HitRecord* hitRecords) { GeometryUtils::HitTest_TriangleMeshPacket(mesh, packet, hitRecords); },
+				seed++);
+		}
+
+		for (Scene* pScene : { static_cast<Scene*>(&sphereField), static_cast<Scene*>(&occluders) })
+		{
+			Renderer singleRays{ 70, 45 };
+			singleRays.SetPacketWidth(1);
+			Renderer packets{ 70, 45 };
+			singleRays.Render(pScene);
+			packets.Render(pScene);
+			EXPECT_TRUE(FrameBuffersMatch(singleRays.GetFrameBuffer(), packets.GetFrameBuffer()));
+		}
+	}
+
+	// Re-lighting the G-buffer has to give the image a full trace with the new settings gives
+	TEST(GBuffer, ReshadeMatchesFullRender) {
+		ShadowScene scene{};
+		scene.Initialize();
+		Renderer renderer{ 64, 48 };
+		renderer.SetProgressive(false);
+
+		// Starts without shadows, so the visibility bits are traced by the reshade
+		renderer.ToggleShadows();
+		renderer.Render(&scene);
+		for (int i{}; i < 4; ++i)
+		{
+			Renderer reference{ 64, 48 };
+			reference.SetProgressive(false);
+			for (int j{}; j <= i; ++j)
+			{
+				reference.CycleLightingMode();
+			}
+			if (i % 2 == 1)
+				reference.ToggleShadows();
+			reference.Render(&scene);
+
+			renderer.CycleLightingMode();
+			renderer.ToggleShadows();
+			renderer.Render(&scene);
+			EXPECT_TRUE(FrameBuffersMatch(reference.GetFrameBuffer(), renderer.GetFrameBuffer()));
+		}
+	}
+
+	// The stages reorder the work, never the result, also for the jittered samples that are added on top
+	TEST(Wavefront, MatchesTiledRender) {
+		ShadowScene scene{};
+		scene.Initialize();
+		Renderer tiled{ 70, 45 };
+		Renderer wavefront{ 70, 45 };
+		wavefront.SetWavefront(true);
+		for (int frame{}; frame < 3; ++frame)
+		{
+			tiled.Render(&scene);
+			wavefront.Render(&scene);
+			EXPECT_TRUE(FrameBuffersMatch(tiled.GetFrameBuffer(), wavefront.GetFrameBuffer()));
+		}
+
+		tiled.ToggleShadows();
+		wavefront.ToggleShadows();
+		tiled.Render(&scene);
+		wavefront.Render(&scene);
+		EXPECT_TRUE(FrameBuffersMatch(tiled.GetFrameBuffer(), wavefront.GetFrameBuffer()));
+	}
+
+	// The batches and the single hit path switch on the type, the virtual Shade stays the reference
+	TEST(MaterialBatch, MatchesVirtualShade) {
+		const Material_SolidColor solidColor{ colors::Magenta };
+		const Material_Lambert lambert{ { .49f, .57f, .57f }, 1.f };
+		const Material_LambertPhong lambertPhong{ colors::Blue, .5f, .5f, 15.f };
+		const Material_CookTorrence metal{ { .972f, .960f, .915f }, 1.f, .6f };
+		const Material_CookTorrence plastic{ { .75f, .75f, .75f }, 0.f, .1f };
+
+		std::mt19937 generator{ 5 };
+		std::uniform_real_distribution<float> distribution{ -1.f, 1.f };
+		auto randomDirection{ [&]() { return Vector3{ distribution(generator), distribution(generator), distribution(generator) }.Normalized(); } };
+
+		ShadingBatch batch{};
+		batch.size = 37;
+		HitRecord hits[ShadingBatch::MaxSize]{};
+		Vector3 lights[ShadingBatch::MaxSize]{};
+		Vector3 views[ShadingBatch::MaxSize]{};
+		for (int i{}; i < batch.size; ++i)
+		{
+			hits[i].normal = randomDirection();
+			lights[i] = randomDirection();
+			views[i] = randomDirection();
+			batch.normalX[i] = hits[i].normal.x;
+			batch.normalY[i] = hits[i].normal.y;
+			batch.normalZ[i] = hits[i].normal.z;
+			batch.lightX[i] = lights[i].x;
+			batch.lightY[i] = lights[i].y;
+			batch.lightZ[i] = lights[i].z;
+			batch.viewX[i] = views[i].x;
+			batch.viewY[i] = views[i].y;
+			batch.viewZ[i] = views[i].z;
+		}
+
+		for (const Material* pMaterial : std::initializer_list<const Material*>{ &solidColor, &lambert, &lambertPhong, &metal, &plastic })
+		{
+			const MaterialData data{ pMaterial->GetData() };
+			float red[ShadingBatch::MaxSize], green[ShadingBatch::MaxSize], blue[ShadingBatch::MaxSize];
+			ShadeBatch(data, batch, red, green, blue);
+			for (int i{}; i < batch.size; ++i)
+			{
+				const ColorRGB expected{ pMaterial->Shade(hits[i], lights[i], views[i]) };
+				const ColorRGB single{ ShadeMaterial(data, hits[i].normal, lights[i], views[i]) };
+				EXPECT_FLOAT_EQ(expected.r, red[i]);
+				EXPECT_FLOAT_EQ(expected.g, green[i]);
+				EXPECT_FLOAT_EQ(expected.b, blue[i]);
+				EXPECT_EQ(red[i], single.r);
+				EXPECT_EQ(green[i], single.g);
+				EXPECT_EQ(blue[i], single.b);
+			}
+		}
+	}
+
+	// Big enough to be split into several chunks, the merged arrays must be in file order
+	TEST(OBJLoader, ChunkedParseMatchesFileOrder) {
+		std::mt19937 generator{ 3 };
+		std::uniform_real_distribution<float> coordinate{ -100.f, 100.f };
+		std::string text{ "# generated\r\n" };
+		std::vector<Vector3> expectedPositions{};
+		std::vector<int> expectedIndices{};
+		char line[128];
+		while (text.size() < 5 * (1 << 20))
+		{
+			const Vector3 position{ coordinate(generator), coordinate(generator), coordinate(generator) };
+			std::snprintf(line, sizeof(line), "v  %.9g %.9g\t%.9g\n", position.x, position.y, position.z);
+			text += line;
+			expectedPositions.push_back(position);
+
+			if (expectedPositions.size() >= 3 && expectedPositions.size() % 2 == 0)
+			{
+				const int last{ static_cast<int>(expectedPositions.size()) };
+				std::snprintf(line, sizeof(line), "f -1 %d 1\r\n", last - 2);
+				text += line;
+				expectedIndices.insert(expectedIndices.end(), { last - 1, last - 3, 0 });
+			}
+		}
+
+		std::vector<Vector3> positions{};
+		std::vector<Vector3> normals{};
+		std::vector<int> indices{};
+		ASSERT_TRUE(ParseOBJText(text.data(), text.size(), positions, normals, indices, 4));
+		EXPECT_EQ(expectedPositions, positions);
+		EXPECT_EQ(expectedIndices, indices);
+		ASSERT_EQ(indices.size() / 3, normals.size());
+
+		const Vector3 normal{ Vector3::Cross(positions[indices[4]] - positions[indices[3]], positions[indices[5]] - positions[indices[3]]).Normalized() };
+		EXPECT_EQ(normal, normals[1]);
+
+		// A face that points past the vertices fails the load
+		const std::string broken{ "v 0 0 0\nv 1 0 0\nf 1 2 3\n" };
+		positions.clear();
+		normals.clear();
+		indices.clear();
+		EXPECT_FALSE(ParseOBJText(broken.data(), broken.size(), positions, normals, indices));
+	}
+
+	// Quads and pentagons are fanned, a position used with two normals becomes two vertices
+	TEST(OBJLoader, FullFaceSyntax) {
+		const std::string text{
+			"o Test\n"
+			"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv .5 2 0\n"
+			"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1 0\n"
+			"vn 0 0 1\nvn 0 0 -1\n"
+			"f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+			"f -5//-1 -2//-1 -1//-1 -3//-1 -4//-1 # back side\n"
+			"f 1/1 3/3/1 5//2\n" };
+
+		TriangleMesh mesh{};
+		ASSERT_TRUE(ParseOBJText(text.data(), text.size(), mesh));
+		const std::vector<int> expectedIndices{ 0, 1, 2, 0, 2, 3, 5, 6, 4, 5, 4, 7, 5, 7, 8, 9, 2, 4 };
+		EXPECT_EQ(expectedIndices, mesh.indices);
+		ASSERT_EQ(10u, mesh.positions.size());
+		ASSERT_EQ(mesh.positions.size(), mesh.vertexNormals.size());
+		ASSERT_EQ(mesh.positions.size(), mesh.uvs.size());
+		ASSERT_EQ(6u, mesh.normals.size());
+
+		// The first combination keeps the position's own slot, later ones are appended once
+		EXPECT_EQ((Vector3{ .5f, 2.f, 0.f }), mesh.positions[4]);
+		EXPECT_EQ(-Vector3::UnitZ, mesh.vertexNormals[4]);
+		EXPECT_EQ(mesh.positions[0], mesh.positions[5]);
+		EXPECT_EQ(Vector3::UnitZ, mesh.vertexNormals[0]);
+		EXPECT_EQ(-Vector3::UnitZ, mesh.vertexNormals[5]);
+		EXPECT_EQ(1.f, mesh.uvs[2].u);
+		EXPECT_EQ(1.f, mesh.uvs[3].v);
+		EXPECT_EQ(0.f, mesh.uvs[9].u);
+		EXPECT_EQ(Vector3{}, mesh.vertexNormals[9]);
+		EXPECT_EQ(Vector3::UnitZ, mesh.normals[0]);
+		EXPECT_EQ(-Vector3::UnitZ, mesh.normals[2]);
+
+		// Without somewhere to put them the attributes are only validated, the vertices stay the file's
+		std::vector<Vector3> positions{};
+		std::vector<Vector3> normals{};
+		std::vector<int> indices{};
+		ASSERT_TRUE(ParseOBJText(text.data(), text.size(), positions, normals, indices));
+		EXPECT_EQ(5u, positions.size());
+		const std::vector<int> expectedPositionIndices{ 0, 1, 2, 0, 2, 3, 0, 3, 4, 0, 4, 2, 0, 2, 1, 0, 2, 4 };
+		EXPECT_EQ(expectedPositionIndices, indices);
+
+		for (const std::string& broken : { std::string{ "v 0 0 0\nv 1 0 0\nf 1 2\n" }, std::string{ "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1/2 2 3\n" }, std::string{ "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n" } })
+		{
+			positions.clear();
+			normals.clear();
+			indices.clear();
+			EXPECT_FALSE(ParseOBJText(broken.data(), broken.size(), positions, normals, indices)) << broken;
+		}
+	}
+
+	// The second load comes from the cache and has to give the same mesh and tree, an edited OBJ invalidates it
+	TEST(MeshCache, RoundTripsAndDetectsChanges) {
+		const std::string filename{ (std::filesystem::temp_directory_path() / "dae_mesh_cache_test.obj").string() };
+		const auto writeOBJ{ [&](float height)
+			{
+				std::ofstream stream{ filename, std::ios::trunc };
+				stream << "v 0 0 0\nv 1 0 0\nv 1 " << height << " 0\nv 0 1 0\nv 0 0 1\nvt 0 0\nvn 0 0 1\n";
+				stream << "f 1/1/1 2/1/1 3/1/1 4/1/1\nf 1 2 5\nf 1 5 4\n";
+			} };
+		writeOBJ(1.f);
+		std::filesystem::remove(GetMeshCacheFilename(filename));
+
+		TriangleMesh parsed{};
+		ASSERT_TRUE(LoadCachedOBJ(filename, parsed));
+		ASSERT_TRUE(std::filesystem::exists(GetMeshCacheFilename(filename)));
+		EXPECT_EQ(parsed.indices.size() / 3, parsed.triangles.size());
+		EXPECT_FALSE(parsed.bvh.IsEmpty());
+
+		TriangleMesh cached{};
+		ASSERT_TRUE(LoadCachedOBJ(filename, cached));
+		EXPECT_EQ(parsed.positions, cached.positions);
+		EXPECT_EQ(parsed.normals, cached.normals);
+		EXPECT_EQ(parsed.indices, cached.indices);
+		EXPECT_EQ(parsed.vertexNormals, cached.vertexNormals);
+		ASSERT_EQ(parsed.uvs.size(), cached.uvs.size());
+		ASSERT_EQ(parsed.bvh.GetNodes().size(), cached.bvh.GetNodes().size());
+		EXPECT_EQ(0, std::memcmp(parsed.bvh.GetNodes().data(), cached.bvh.GetNodes().data(), parsed.bvh.GetNodes().size() * sizeof(BVHNode)));
+		EXPECT_EQ(parsed.bvh.GetPrimitiveIndices(), cached.bvh.GetPrimitiveIndices());
+		EXPECT_EQ(parsed.triangles.size(), cached.triangles.size());
+		EXPECT_EQ(parsed.minAABB, cached.minAABB);
+		EXPECT_EQ(parsed.maxAABB, cached.maxAABB);
+
+		writeOBJ(12.5f);
+		TriangleMesh edited{};
+		ASSERT_TRUE(LoadCachedOBJ(filename, edited));
+		EXPECT_EQ(12.5f, edited.positions[2].y);
+		EXPECT_EQ(12.5f, edited.maxAABB.y);
+
+		// An index pointing past the positions makes the cache invalid, the OBJ is parsed again
+		std::string cacheBytes{};
+		{
+			std::ifstream stream{ GetMeshCacheFilename(filename), std::ios::binary };
+			cacheBytes.assign(std::istreambuf_iterator<char>{ stream }, std::istreambuf_iterator<char>{});
+		}
+		const size_t indicesOffset{ cacheBytes.find(std::string(reinterpret_cast<const char*>(edited.indices.data()), edited.indices.size() * sizeof(int))) };
+		ASSERT_NE(std::string::npos, indicesOffset);
+		const int badIndex{ static_cast<int>(edited.positions.size()) };
+		std::memcpy(cacheBytes.data() + indicesOffset, &badIndex, sizeof(int));
+		{
+			std::ofstream stream{ GetMeshCacheFilename(filename), std::ios::binary | std::ios::trunc };
+			stream.write(cacheBytes.data(), cacheBytes.size());
+		}
+		TriangleMesh corrupted{};
+		ASSERT_TRUE(LoadCachedOBJ(filename, corrupted));
+		EXPECT_EQ(edited.indices, corrupted.indices);
+		EXPECT_EQ(edited.positions, corrupted.positions);
+
+		std::filesystem::remove(filename);
+		std::filesystem::remove(GetMeshCacheFilename(filename));
+	}
+
+	// The threaded SSE passes have to round exactly like the scalar Vector3 and Matrix math, including the tails
+	TEST(MeshKernels, MatchScalarMath) {
+		std::mt19937 generator{ 5 };
+		std::uniform_real_distribution<float> coordinate{ -50.f, 50.f };
+		std::vector<Vector3> positions(50003);
+		for (Vector3& position : positions)
+			position = { coordinate(generator), coordinate(generator), coordinate(generator) };
+		std::uniform_int_distribution<int> vertex{ 0, static_cast<int>(positions.size()) - 1 };
+		std::vector<int> indices(3 * 30001);
+		for (int& index : indices)
+			index = vertex(generator);
+
+		// Vector3::operator== has a tolerance
+		const auto isBitEqual{ [](const Vector3& expected, const Vector3& actual) { return std::memcmp(&expected, &actual, sizeof(Vector3)) == 0; } };
+
+		const Matrix transform{ Matrix::CreateScale(2.f, .5f, 3.f) * Matrix::CreateRotation(.3f, 1.2f, -.4f) * Matrix::CreateTranslation(4.f, -1.f, 2.f) };
+		for (SimdLevel simdLevel : { SimdLevel::Scalar, SimdLevel::SSE41 })
+		{
+			std::vector<Vector3> points{};
+			std::vector<Vector3> vectors{};
+			TransformPoints(transform, positions, points, simdLevel);
+			TransformVectors(transform, positions, vectors, simdLevel);
+			ASSERT_EQ(positions.size(), points.size());
+			ASSERT_EQ(positions.size(), vectors.size());
+			for (size_t i{}; i < positions.size(); ++i)
+			{
+				ASSERT_TRUE(isBitEqual(transform.TransformPoint(positions[i]), points[i])) << i;
+				ASSERT_TRUE(isBitEqual(transform.TransformVector(positions[i]), vectors[i])) << i;
+			}
+
+			std::vector<Vector3> normals(indices.size() / 3);
+			CalculateTriangleNormals(positions.data(), indices.data(), normals.size(), normals.data(), simdLevel);
+			for (size_t i{}; i < normals.size(); ++i)
+			{
+				const Vector3 e1{ positions[indices[i * 3 + 1]] - positions[indices[i * 3]] };
+				const Vector3 e2{ positions[indices[i * 3 + 2]] - positions[indices[i * 3]] };
+				ASSERT_TRUE(isBitEqual(Vector3::Cross(e1, e2).Normalized(), normals[i])) << i;
+			}
+		}
+
+		// The buffers are resized in place, a second pass over fewer triangles reuses them
+		std::vector<Vector3> normals{};
+		CalculateTriangleNormals(positions, indices, normals);
+		EXPECT_EQ(indices.size() / 3, normals.size());
+		indices.resize(30);
+		CalculateTriangleNormals(positions, indices, normals);
+		EXPECT_EQ(10u, normals.size());
+	}
+
 	int main(int argc, char** argv) {
 		::testing::InitGoogleTest(&argc, argv);
 		return RUN_ALL_TESTS();